@@ -0,0 +1,322 @@
+#include "Corpus.hpp"
+#include "ReaderFields.hpp"
+#include <algorithm>
+#include <random>
+
+std::unique_ptr<ReaderFrame> make_json_reader(TweetUser *p)
+{
+    static const ReaderFields<TweetUser> fields = {
+        { "id", &TweetUser::id },
+        { "screen_name", &TweetUser::screen_name },
+        { "name", &TweetUser::name },
+        { "location", &TweetUser::location },
+        { "followers_count", &TweetUser::followers_count },
+        { "friends_count", &TweetUser::friends_count },
+        { "verified", &TweetUser::verified }
+    };
+    return make_json_fields_reader(p, fields);
+}
+
+std::unique_ptr<ReaderFrame> make_json_reader(Tweet *p)
+{
+    static const ReaderFields<Tweet> fields = {
+        { "id", &Tweet::id },
+        { "created_at", &Tweet::created_at },
+        { "text", &Tweet::text },
+        { "user", &Tweet::user },
+        { "hashtags", &Tweet::hashtags },
+        { "mention_ids", &Tweet::mention_ids },
+        { "retweet_count", &Tweet::retweet_count },
+        { "favorite_count", &Tweet::favorite_count },
+        { "favorited", &Tweet::favorited },
+        { "retweeted", &Tweet::retweeted },
+        { "lang", &Tweet::lang }
+    };
+    return make_json_fields_reader(p, fields);
+}
+
+std::unique_ptr<ReaderFrame> make_json_reader(Numbers *p)
+{
+    static const ReaderFields<Numbers> fields = {
+        { "values", &Numbers::values },
+        { "ids", &Numbers::ids },
+        { "min", &Numbers::min },
+        { "max", &Numbers::max },
+        { "mean", &Numbers::mean }
+    };
+    return make_json_fields_reader(p, fields);
+}
+
+std::unique_ptr<ReaderFrame> make_json_reader(Node *p)
+{
+    static const ReaderFields<Node> fields = {
+        { "id", &Node::id },
+        { "name", &Node::name },
+        { "children", &Node::children }
+    };
+    return make_json_fields_reader(p, fields);
+}
+
+std::unique_ptr<ReaderFrame> make_json_reader(LongStrings *p)
+{
+    static const ReaderFields<LongStrings> fields = {
+        { "strings", &LongStrings::strings }
+    };
+    return make_json_fields_reader(p, fields);
+}
+
+void read_json_value(JsonPullReader &reader, TweetUser *p)
+{
+    static const auto fields = make_json_static_fields(
+        json_field("id", &TweetUser::id),
+        json_field("screen_name", &TweetUser::screen_name),
+        json_field("name", &TweetUser::name),
+        json_field("location", &TweetUser::location),
+        json_field("followers_count", &TweetUser::followers_count),
+        json_field("friends_count", &TweetUser::friends_count),
+        json_field("verified", &TweetUser::verified));
+    fields.read(reader, p);
+}
+
+void read_json_value(JsonPullReader &reader, Tweet *p)
+{
+    static const auto fields = make_json_static_fields(
+        json_field("id", &Tweet::id),
+        json_field("created_at", &Tweet::created_at),
+        json_field("text", &Tweet::text),
+        json_field("user", &Tweet::user),
+        json_field("hashtags", &Tweet::hashtags),
+        json_field("mention_ids", &Tweet::mention_ids),
+        json_field("retweet_count", &Tweet::retweet_count),
+        json_field("favorite_count", &Tweet::favorite_count),
+        json_field("favorited", &Tweet::favorited),
+        json_field("retweeted", &Tweet::retweeted),
+        json_field("lang", &Tweet::lang));
+    fields.read(reader, p);
+}
+
+void read_json_value(JsonPullReader &reader, Numbers *p)
+{
+    static const auto fields = make_json_static_fields(
+        json_field("values", &Numbers::values),
+        json_field("ids", &Numbers::ids),
+        json_field("min", &Numbers::min),
+        json_field("max", &Numbers::max),
+        json_field("mean", &Numbers::mean));
+    fields.read(reader, p);
+}
+
+void read_json_value(JsonPullReader &reader, Node *p)
+{
+    static const auto fields = make_json_static_fields(
+        json_field("id", &Node::id),
+        json_field("name", &Node::name),
+        json_field("children", &Node::children));
+    fields.read(reader, p);
+}
+
+void read_json_value(JsonPullReader &reader, LongStrings *p)
+{
+    static const auto fields = make_json_static_fields(
+        json_field("strings", &LongStrings::strings));
+    fields.read(reader, p);
+}
+
+void write_json(JsonWriter &writer, const TweetUser &x)
+{
+    writer.start_object();
+    writer.prop("id", x.id);
+    writer.prop("screen_name", x.screen_name);
+    writer.prop("name", x.name);
+    writer.prop("location", x.location);
+    writer.prop("followers_count", x.followers_count);
+    writer.prop("friends_count", x.friends_count);
+    writer.prop("verified", x.verified);
+    writer.end_object();
+}
+
+void write_json(JsonWriter &writer, const Tweet &x)
+{
+    writer.start_object();
+    writer.prop("id", x.id);
+    writer.prop("created_at", x.created_at);
+    writer.prop("text", x.text);
+    writer.prop("user", x.user);
+    writer.prop("hashtags", x.hashtags);
+    writer.prop("mention_ids", x.mention_ids);
+    writer.prop("retweet_count", x.retweet_count);
+    writer.prop("favorite_count", x.favorite_count);
+    writer.prop("favorited", x.favorited);
+    writer.prop("retweeted", x.retweeted);
+    writer.prop("lang", x.lang);
+    writer.end_object();
+}
+
+void write_json(JsonWriter &writer, const Numbers &x)
+{
+    writer.start_object();
+    writer.prop("values", x.values);
+    writer.prop("ids", x.ids);
+    writer.prop("min", x.min);
+    writer.prop("max", x.max);
+    writer.prop("mean", x.mean);
+    writer.end_object();
+}
+
+void write_json(JsonWriter &writer, const Node &x)
+{
+    writer.start_object();
+    writer.prop("id", x.id);
+    writer.prop("name", x.name);
+    writer.prop("children", x.children);
+    writer.end_object();
+}
+
+void write_json(JsonWriter &writer, const LongStrings &x)
+{
+    writer.start_object();
+    writer.prop("strings", x.strings);
+    writer.end_object();
+}
+
+namespace
+{
+    typedef std::mt19937_64 Random;
+
+    const char *const WORDS[] = {
+        "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "json", "parser",
+        "benchmark", "stream", "socket", "buffer", "latency", "throughput", "cache", "vector",
+        "caf\xC3\xA9", "na\xC3\xAFve", "\xE6\x97\xA5\xE6\x9C\xAC", "emoji \xF0\x9F\x98\x80"
+    };
+
+    size_t uniform(Random &random, size_t n)
+    {
+        return (size_t)(random() % n);
+    }
+
+    std::string words(Random &random, size_t count)
+    {
+        std::string str;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i) str += ' ';
+            str += WORDS[uniform(random, sizeof(WORDS) / sizeof(WORDS[0]))];
+        }
+        return str;
+    }
+
+    template<class T>
+    void serialize(Corpus<T> &corpus)
+    {
+        JsonWriter writer;
+        corpus.bytes = 0;
+        for (auto &value : corpus.values)
+        {
+            writer.reset();
+            writer.value(value);
+            corpus.documents.emplace_back(writer.data(), writer.size());
+            corpus.bytes += writer.size();
+        }
+    }
+
+    Node make_node(Random &random, int id, int depth)
+    {
+        Node node;
+        node.id = id;
+        node.name = words(random, 1);
+        if (depth > 0)
+        {
+            // A chain to the full depth, with an occasional leaf alongside
+            node.children.push_back(make_node(random, id + 1, depth - 1));
+            if (uniform(random, 4) == 0) node.children.push_back(make_node(random, id + 1000, 0));
+        }
+        return node;
+    }
+}
+
+Corpus<Tweet> make_tweet_corpus(size_t count)
+{
+    Random random(1);
+    Corpus<Tweet> corpus;
+    corpus.name = "tweets";
+    for (size_t i = 0; i < count; ++i)
+    {
+        Tweet tweet;
+        tweet.id = 1000000000000000000ull + random() % 1000000000000ull;
+        tweet.created_at = "Mon Sep 24 03:35:21 +0000 2012";
+        tweet.text = words(random, 8 + uniform(random, 16));
+        if (uniform(random, 3) == 0) tweet.text += " \"quoted\"\n";
+        tweet.user.id = random() % 10000000000ull;
+        tweet.user.screen_name = "user_" + std::to_string(uniform(random, 100000));
+        tweet.user.name = words(random, 2);
+        tweet.user.location = words(random, 1 + uniform(random, 3));
+        tweet.user.followers_count = (int)uniform(random, 1000000);
+        tweet.user.friends_count = (int)uniform(random, 5000);
+        tweet.user.verified = uniform(random, 10) == 0;
+        for (size_t j = uniform(random, 4); j > 0; --j) tweet.hashtags.push_back(words(random, 1));
+        for (size_t j = uniform(random, 3); j > 0; --j) tweet.mention_ids.push_back(random() % 10000000000ull);
+        tweet.retweet_count = (int)uniform(random, 10000);
+        tweet.favorite_count = (int)uniform(random, 10000);
+        tweet.favorited = uniform(random, 2) == 0;
+        tweet.retweeted = uniform(random, 2) == 0;
+        tweet.lang = uniform(random, 2) ? "en" : "ja";
+        corpus.values.push_back(std::move(tweet));
+    }
+    serialize(corpus);
+    return corpus;
+}
+
+Corpus<Numbers> make_numbers_corpus(size_t count)
+{
+    Random random(2);
+    std::normal_distribution<double> normal(0.0, 1000.0);
+    Corpus<Numbers> corpus;
+    corpus.name = "numbers";
+    for (size_t i = 0; i < count; ++i)
+    {
+        Numbers numbers;
+        for (int j = 0; j < 512; ++j) numbers.values.push_back(normal(random));
+        for (int j = 0; j < 128; ++j) numbers.ids.push_back((long long)(random() >> 1));
+        numbers.min = *std::min_element(numbers.values.begin(), numbers.values.end());
+        numbers.max = *std::max_element(numbers.values.begin(), numbers.values.end());
+        numbers.mean = 0;
+        for (auto x : numbers.values) numbers.mean += x / (double)numbers.values.size();
+        corpus.values.push_back(std::move(numbers));
+    }
+    serialize(corpus);
+    return corpus;
+}
+
+Corpus<Node> make_nested_corpus(size_t count, int depth)
+{
+    Random random(3);
+    Corpus<Node> corpus;
+    corpus.name = "nested";
+    for (size_t i = 0; i < count; ++i) corpus.values.push_back(make_node(random, 0, depth));
+    serialize(corpus);
+    return corpus;
+}
+
+Corpus<LongStrings> make_long_strings_corpus(size_t count)
+{
+    Random random(4);
+    Corpus<LongStrings> corpus;
+    corpus.name = "strings";
+    for (size_t i = 0; i < count; ++i)
+    {
+        LongStrings strings;
+        for (int j = 0; j < 8; ++j)
+        {
+            std::string str = words(random, 1000 + uniform(random, 2000));
+            // Sparse escapes, as in embedded text and paths
+            for (size_t k = uniform(random, 512); k < str.size(); k += 256 + uniform(random, 1024))
+            {
+                str[k] = "\"\\\n\t"[uniform(random, 4)];
+            }
+            strings.strings.push_back(std::move(str));
+        }
+        corpus.values.push_back(std::move(strings));
+    }
+    serialize(corpus);
+    return corpus;
+}
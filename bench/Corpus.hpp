@@ -0,0 +1,87 @@
+#pragma once
+#include "Reader.hpp"
+#include "ReaderStatic.hpp"
+#include "Writer.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Record types for the benchmark corpora, with their JSON readers and writers.
+
+struct TweetUser
+{
+    uint64_t id;
+    std::string screen_name;
+    std::string name;
+    std::string location;
+    int followers_count;
+    int friends_count;
+    bool verified;
+};
+struct Tweet
+{
+    uint64_t id;
+    std::string created_at;
+    std::string text;
+    TweetUser user;
+    std::vector<std::string> hashtags;
+    std::vector<uint64_t> mention_ids;
+    int retweet_count;
+    int favorite_count;
+    bool favorited;
+    bool retweeted;
+    std::string lang;
+};
+/**Numeric heavy record, mostly arrays of doubles.*/
+struct Numbers
+{
+    std::vector<double> values;
+    std::vector<long long> ids;
+    double min, max, mean;
+};
+/**Deeply nested record.*/
+struct Node
+{
+    int id;
+    std::string name;
+    std::vector<Node> children;
+};
+/**Record of a few long strings, some needing escapes.*/
+struct LongStrings
+{
+    std::vector<std::string> strings;
+};
+
+std::unique_ptr<ReaderFrame> make_json_reader(TweetUser *p);
+std::unique_ptr<ReaderFrame> make_json_reader(Tweet *p);
+std::unique_ptr<ReaderFrame> make_json_reader(Numbers *p);
+std::unique_ptr<ReaderFrame> make_json_reader(Node *p);
+std::unique_ptr<ReaderFrame> make_json_reader(LongStrings *p);
+
+void read_json_value(JsonPullReader &reader, TweetUser *p);
+void read_json_value(JsonPullReader &reader, Tweet *p);
+void read_json_value(JsonPullReader &reader, Numbers *p);
+void read_json_value(JsonPullReader &reader, Node *p);
+void read_json_value(JsonPullReader &reader, LongStrings *p);
+
+void write_json(JsonWriter &writer, const TweetUser &x);
+void write_json(JsonWriter &writer, const Tweet &x);
+void write_json(JsonWriter &writer, const Numbers &x);
+void write_json(JsonWriter &writer, const Node &x);
+void write_json(JsonWriter &writer, const LongStrings &x);
+
+/**Generated records of one type, and each serialized as a JSON document.*/
+template<class T>
+struct Corpus
+{
+    std::string name;
+    std::vector<T> values;
+    std::vector<std::string> documents;
+    size_t bytes;
+};
+
+/**Build each corpus from a fixed seed, so runs are comparable.*/
+Corpus<Tweet> make_tweet_corpus(size_t count);
+Corpus<Numbers> make_numbers_corpus(size_t count);
+Corpus<Node> make_nested_corpus(size_t count, int depth);
+Corpus<LongStrings> make_long_strings_corpus(size_t count);
@@ -0,0 +1,232 @@
+// Throughput of read_json and JsonWriter on generated corpora, alongside plain rapidjson.
+//
+//     rapidjson-ext-bench [min_seconds] [filter]
+//
+// Each benchmark repeats over its whole corpus for at least min_seconds (default 0.5), and
+// reports MB/s of JSON text, ns per document and heap allocations per document. Only the
+// benchmarks whose corpus or operation name contains filter are run.
+#include "Corpus.hpp"
+#include "WriterCache.hpp"
+#include <rapidjson/document.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace
+{
+    std::atomic<size_t> allocations(0);
+}
+
+// Count every heap allocation in the process, for allocations per document
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p)noexcept
+{
+    std::free(p);
+}
+void operator delete(void *p, size_t)noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double min_seconds = 0.5;
+    const char *filter = nullptr;
+    /**Written by each benchmark so its work is not optimized away.*/
+    volatile size_t sink;
+
+    /**Counts events, for the SAX baseline.*/
+    struct CountHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, CountHandler>
+    {
+        size_t events = 0;
+        bool Default()
+        {
+            ++events;
+            return true;
+        }
+    };
+
+    template<class F>
+    void run(const std::string &corpus, const char *name, size_t bytes, size_t documents, F &&f)
+    {
+        if (filter && corpus.find(filter) == std::string::npos && !std::strstr(name, filter)) return;
+
+        f(); // Warm up caches and any pooled buffers
+        size_t iterations = 0;
+        size_t allocations_start = allocations.load();
+        auto start = Clock::now();
+        double elapsed;
+        do
+        {
+            f();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < min_seconds);
+        size_t allocated = allocations.load() - allocations_start;
+
+        double per_iteration = elapsed / (double)iterations;
+        std::printf("%-8s %-22s %9.1f MB/s %10.0f ns/doc %9.2f allocs/doc\n",
+            corpus.c_str(), name,
+            (double)bytes / per_iteration / 1e6,
+            per_iteration * 1e9 / (double)documents,
+            (double)allocated / (double)iterations / (double)documents);
+    }
+
+    template<class T>
+    void bench(const Corpus<T> &corpus)
+    {
+        size_t documents = corpus.documents.size();
+
+        run(corpus.name, "read_json", corpus.bytes, documents, [&]()
+        {
+            size_t n = 0;
+            for (auto &doc : corpus.documents)
+            {
+                T value;
+                read_json(doc.data(), doc.size(), &value);
+                n += sizeof(value);
+            }
+            sink = n;
+        });
+        run(corpus.name, "read_json_static", corpus.bytes, documents, [&]()
+        {
+            size_t n = 0;
+            for (auto &doc : corpus.documents)
+            {
+                T value;
+                read_json_static(doc.data(), doc.size(), &value);
+                n += sizeof(value);
+            }
+            sink = n;
+        });
+        // The same values as CBOR, with throughput still measured against the JSON size
+        std::vector<std::string> cbor_documents;
+        for (auto &value : corpus.values)
+        {
+            JsonWriter writer;
+            writer.set_encoding(JsonEncoding::cbor);
+            writer.value(value);
+            cbor_documents.emplace_back(writer.data(), writer.size());
+        }
+        run(corpus.name, "read_cbor", corpus.bytes, documents, [&]()
+        {
+            size_t n = 0;
+            for (auto &doc : cbor_documents)
+            {
+                T value;
+                read_cbor(doc.data(), doc.size(), &value);
+                n += sizeof(value);
+            }
+            sink = n;
+        });
+        run(corpus.name, "rapidjson Document", corpus.bytes, documents, [&]()
+        {
+            size_t n = 0;
+            for (auto &doc : corpus.documents)
+            {
+                rapidjson::Document document;
+                document.Parse(doc.data(), doc.size());
+                if (document.HasParseError()) throw std::runtime_error("Parse error");
+                ++n;
+            }
+            sink = n;
+        });
+        run(corpus.name, "rapidjson Reader", corpus.bytes, documents, [&]()
+        {
+            rapidjson::Reader reader;
+            CountHandler handler;
+            for (auto &doc : corpus.documents)
+            {
+                rapidjson::MemoryStream ms(doc.data(), doc.size());
+                if (!reader.Parse(ms, handler)) throw std::runtime_error("Parse error");
+            }
+            sink = handler.events;
+        });
+
+        run(corpus.name, "JsonWriter", corpus.bytes, documents, [&]()
+        {
+            JsonWriter writer;
+            size_t n = 0;
+            for (auto &value : corpus.values)
+            {
+                writer.reset();
+                writer.value(value);
+                n += writer.size();
+            }
+            sink = n;
+        });
+        run(corpus.name, "JsonWriter cbor", corpus.bytes, documents, [&]()
+        {
+            JsonWriter writer;
+            writer.set_encoding(JsonEncoding::cbor);
+            size_t n = 0;
+            for (auto &value : corpus.values)
+            {
+                writer.reset();
+                writer.value(value);
+                n += writer.size();
+            }
+            sink = n;
+        });
+        // Every value is cached, so this is the cost of splicing the serialized fragments
+        JsonFragmentCache cache(documents);
+        run(corpus.name, "JsonWriter cached", corpus.bytes, documents, [&]()
+        {
+            JsonWriter writer;
+            size_t n = 0;
+            for (auto &value : corpus.values)
+            {
+                writer.reset();
+                cache.write(writer, value, 1);
+                n += writer.size();
+            }
+            sink = n;
+        });
+        // The baseline writes from a parsed DOM, as plain rapidjson has no typed writer
+        std::vector<rapidjson::Document> parsed(documents);
+        for (size_t i = 0; i < documents; ++i)
+        {
+            parsed[i].Parse(corpus.documents[i].data(), corpus.documents[i].size());
+        }
+        run(corpus.name, "rapidjson Writer", corpus.bytes, documents, [&]()
+        {
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            size_t n = 0;
+            for (auto &document : parsed)
+            {
+                buffer.Clear();
+                writer.Reset(buffer);
+                document.Accept(writer);
+                n += buffer.GetSize();
+            }
+            sink = n;
+        });
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) min_seconds = std::atof(argv[1]);
+    if (argc > 2) filter = argv[2];
+
+    bench(make_tweet_corpus(2000));
+    bench(make_numbers_corpus(200));
+    bench(make_nested_corpus(2000, 64));
+    bench(make_long_strings_corpus(20));
+    return 0;
+}
@@ -50,6 +50,46 @@ namespace rapidjson_ext_detail
      */
     template <class T> struct is_iterable : public decltype(is_iterable_impl<T>(0)) {};
 
+    template<class T>
+    auto has_reserve_impl(int) -> decltype(std::declval<T&>().reserve(size_t()), std::true_type{});
+    template<class T>
+    std::false_type has_reserve_impl(...);
+    /**Containers with a reserve(n), such as std::vector.*/
+    template<class T> struct has_reserve : public decltype(has_reserve_impl<T>(0)) {};
+
+    /**Lists read as JSON arrays, which can use a ReaderSizeHint. Strings are read from JSON strings.*/
+    template<class T> struct uses_size_hint : public std::integral_constant<bool,
+        is_list<T>::value && !std::is_same<T, std::string>::value> {};
+
+    /**Reserve room for n more elements, if the container supports it.*/
+    template<class T, typename std::enable_if<has_reserve<T>::value>::type * = nullptr>
+    void reserve_more(T &list, size_t n)
+    {
+        if (n) list.reserve(list.size() + n);
+    }
+    template<class T, typename std::enable_if<!has_reserve<T>::value>::type * = nullptr>
+    void reserve_more(T &list, size_t n)
+    {
+    }
+
+    /**Element types JsonWriter::value_array formats in bulk.*/
+    template<class T> struct is_bulk_json_number : public std::integral_constant<bool,
+        std::is_same<T, int>::value || std::is_same<T, unsigned>::value ||
+        std::is_same<T, long>::value || std::is_same<T, unsigned long>::value ||
+        std::is_same<T, long long>::value || std::is_same<T, unsigned long long>::value ||
+        std::is_same<T, float>::value || std::is_same<T, double>::value> {};
+
+    template<class T>
+    auto is_number_array_impl(int) -> decltype(std::size(std::declval<const T&>()),
+        is_bulk_json_number<typename std::remove_cv<typename std::remove_pointer<
+            decltype(std::data(std::declval<const T&>()))>::type>::type>{});
+    template<class T>
+    std::false_type is_number_array_impl(...);
+    /**Contiguous arrays of numbers, such as std::vector<int> or double[N], which are written in
+     * bulk by JsonWriter::value_array.
+     */
+    template<class T> struct is_number_array : public decltype(is_number_array_impl<T>(0)) {};
+
     using std::to_string;
     template<class T> auto has_to_string_impl(int) -> decltype(to_string(std::declval<T>()));
     template<class T> std::false_type has_to_string_impl(...);
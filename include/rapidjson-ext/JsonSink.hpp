@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <iosfwd>
+
+/**Destination for the output of a JsonWriter.
+ *
+ * JsonWriter buffers its output, and passes it to write in large blocks.
+ */
+class JsonSink
+{
+public:
+    virtual ~JsonSink() {}
+
+    /**Write len bytes. Throws on failure.*/
+    virtual void write(const char *data, size_t len) = 0;
+    /**Called after JsonWriter has written everything it has, such as when the top level value is
+     * complete. Sinks that buffer should pass their data on.
+     */
+    virtual void flush() {}
+};
+
+/**Sink writing to a file descriptor.*/
+class JsonFdSink : public JsonSink
+{
+public:
+    explicit JsonFdSink(int fd) : fd(fd) {}
+    virtual void write(const char *data, size_t len)override;
+private:
+    int fd;
+};
+
+/**Sink writing to a C FILE.*/
+class JsonFileSink : public JsonSink
+{
+public:
+    explicit JsonFileSink(FILE *file) : file(file) {}
+    virtual void write(const char *data, size_t len)override;
+    virtual void flush()override;
+private:
+    FILE *file;
+};
+
+/**Sink writing to a std::ostream.*/
+class JsonOStreamSink : public JsonSink
+{
+public:
+    explicit JsonOStreamSink(std::ostream &os) : os(os) {}
+    virtual void write(const char *data, size_t len)override;
+    virtual void flush()override;
+private:
+    std::ostream &os;
+};
+
+/**Sink passing each block of output to a callback.*/
+class JsonCallbackSink : public JsonSink
+{
+public:
+    typedef std::function<void(const char *data, size_t len)> Callback;
+
+    explicit JsonCallbackSink(Callback callback) : callback(std::move(callback)) {}
+    virtual void write(const char *data, size_t len)override { callback(data, len); }
+private:
+    Callback callback;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+/**Counters for read_json and JsonWriter, for finding documents that are slow to parse or write.
+ *
+ * Collection is only compiled in when the library is built with RAPIDJSON_EXT_STATS defined.
+ * Otherwise the hooks compile to nothing, and the counters stay zero, see json_stats_enabled.
+ */
+struct JsonStats
+{
+    /**Documents parsed by read_json, read_json_lines, JsonPushReader and ReaderArrayCursor.*/
+    uint64_t documents_read;
+    /**Bytes of JSON text parsed.*/
+    uint64_t bytes_read;
+    /**Deepest ReaderFrame stack seen.*/
+    uint64_t max_depth;
+    /**ReaderFrame objects created, whether from a ReaderArena or the heap.*/
+    uint64_t frames;
+    /**Bytes of the strings and keys passed to ReaderFrame callbacks, which copy what they keep.*/
+    uint64_t string_bytes;
+    /**Time spent parsing, in nanoseconds.*/
+    uint64_t parse_ns;
+    /**The part of parse_ns spent in ReaderFrame callbacks. The rest is the tokenizer.
+     * Timing every callback slows the parse, so treat this as a relative measure.
+     */
+    uint64_t callback_ns;
+
+    /**Top level values completed by a JsonWriter.*/
+    uint64_t documents_written;
+    /**Bytes written by a JsonWriter, including those already passed to a sink.*/
+    uint64_t bytes_written;
+    /**Times a JsonWriter buffer was reallocated to make it larger.*/
+    uint64_t buffer_grows;
+
+    JsonStats()
+        : documents_read(0), bytes_read(0), max_depth(0), frames(0), string_bytes(0),
+        parse_ns(0), callback_ns(0), documents_written(0), bytes_written(0), buffer_grows(0)
+    {}
+
+    JsonStats &operator += (const JsonStats &other)
+    {
+        documents_read += other.documents_read;
+        bytes_read += other.bytes_read;
+        max_depth = std::max(max_depth, other.max_depth);
+        frames += other.frames;
+        string_bytes += other.string_bytes;
+        parse_ns += other.parse_ns;
+        callback_ns += other.callback_ns;
+        documents_written += other.documents_written;
+        bytes_written += other.bytes_written;
+        buffer_grows += other.buffer_grows;
+        return *this;
+    }
+};
+
+/**True if the library was built with RAPIDJSON_EXT_STATS, so JsonStats are collected.*/
+bool json_stats_enabled();
+
+/**Adds the stats of parsing and writing on this thread to a JsonStats, for the lifetime of the
+ * scope. Scopes nest, with only the innermost receiving the stats.
+ *
+ *     JsonStats stats;
+ *     {
+ *         JsonStatsScope scope(stats);
+ *         read_json(payload, &value);
+ *     }
+ *     if (stats.max_depth > 64) report(payload, stats);
+ *
+ * read_json_lines adds the stats of its worker threads to the scope it was called in.
+ */
+class JsonStatsScope
+{
+public:
+    explicit JsonStatsScope(JsonStats &stats);
+    ~JsonStatsScope();
+
+    JsonStatsScope(const JsonStatsScope &) = delete;
+    JsonStatsScope& operator = (const JsonStatsScope &) = delete;
+
+    /**Stats for this thread, or null outside any scope.*/
+    static JsonStats *current();
+private:
+    JsonStats *prev;
+};
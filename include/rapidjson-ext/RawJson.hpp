@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+/**JSON text of a value, kept as is to be parsed later with read_json, or forwarded unchanged.
+ * Read with make_json_reader(RawJson*), and written by write_json with JsonWriter::value_raw.
+ */
+class RawJson
+{
+public:
+    std::string json;
+};
@@ -1,30 +1,68 @@
 #pragma once
+#include "Detail.hpp"
+#include "ReaderNumbers.hpp"
+#include "RawJson.hpp"
 #include <stdexcept>
+#include <atomic>
 #include <stack>
 #include <memory>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <initializer_list>
+#include <iosfwd>
 #include <cassert>
+#include <cstdint>
 
 class ReaderFrame;
-void read_json(const std::string &str, std::unique_ptr<ReaderFrame> &&root);
 
-template<class T>
-void read_json(const std::string &str, T *p)
-{
-    read_json(str, make_json_reader(p));
-}
+/**Default buffer size for the stream based read_json overloads.*/
+const size_t READ_JSON_BUFFER_SIZE = 64 * 1024;
+
+/**Parse a complete JSON document held in memory.*/
+void read_json(const std::string &str, std::unique_ptr<ReaderFrame> &&root);
+void read_json(const char *str, size_t len, std::unique_ptr<ReaderFrame> &&root);
+/**Parse a JSON document from a stream, reading it buffer_size bytes at a time.
+ * Only the buffer is held in memory, regardless of the size of the document.
+ */
+void read_json(std::istream &is, std::unique_ptr<ReaderFrame> &&root, size_t buffer_size = READ_JSON_BUFFER_SIZE);
+/**Parse a JSON document from a file descriptor, reading it buffer_size bytes at a time.*/
+void read_json_fd(int fd, std::unique_ptr<ReaderFrame> &&root, size_t buffer_size = READ_JSON_BUFFER_SIZE);
+/**Parse a JSON file by memory mapping it read-only, rather than reading it into a buffer.*/
+void read_json_file(const std::string &path, std::unique_ptr<ReaderFrame> &&root);
+/**Parse a null terminated JSON document in-situ.
+ * Strings are unescaped in place, so the string_view passed to ReaderFrame::value_string and
+ * ReaderFrame::key point into str rather than a temporary copy. The contents of str are
+ * destroyed by the parse.
+ */
+void read_json_insitu(char *str, std::unique_ptr<ReaderFrame> &&root);
+void read_json_insitu(std::string &str, std::unique_ptr<ReaderFrame> &&root);
+/**Parse a CBOR (RFC 8949) encoded value held in memory, such as written by JsonWriter with
+ * JsonEncoding::cbor, with the same ReaderFrame callbacks as the equivalent JSON.
+ * Byte strings, non-string keys and simple values other than true, false, null and undefined
+ * are not supported, and tags are ignored.
+ */
+void read_cbor(const char *data, size_t len, std::unique_ptr<ReaderFrame> &&root);
+void read_cbor(const std::string &data, std::unique_ptr<ReaderFrame> &&root);
 
 class ReaderError : public std::runtime_error
 {
 public:
     ReaderError(const char *str) : std::runtime_error(str) {}
+    ReaderError(const std::string &str) : std::runtime_error(str) {}
 };
 class ReaderFrame
 {
 public:
     virtual ~ReaderFrame() {}
 
+    /**Frames created while read_json is running are placed in a per-thread arena that is reused
+     * between documents, rather than being individually heap allocated. Such frames must not
+     * outlive the parse that created them, or be destroyed on another thread.
+     */
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
+
     virtual bool is_array()const { return false; }
 
     virtual void value_null() { throw ReaderError("Unexpected null"); }
@@ -34,14 +72,30 @@ public:
     virtual void value_int64(int64_t i) { throw ReaderError("Unexpected int64"); }
     virtual void value_uint64(uint64_t i) { throw ReaderError("Unexpected uint64"); }
     virtual void value_double(double d) { throw ReaderError("Unexpected double"); }
-    virtual void value_string(const std::string &str) { throw ReaderError("Unexpected string"); }
+    virtual void value_string(std::string_view str) { throw ReaderError("Unexpected string"); }
     virtual std::unique_ptr<ReaderFrame> start_array() { throw ReaderError("Unexpected array"); }
     virtual void end_array() { throw ReaderError("Unexpected array end"); }
     virtual std::unique_ptr<ReaderFrame> start_object() { throw ReaderError("Unexpected object"); }
     virtual void end_object() { throw ReaderError("Unexpected object end"); }
-    virtual std::unique_ptr<ReaderFrame> key(const std::string &str) { throw ReaderError("Unexpected key"); }
+    /**Frame for the value of an object key, or null to skip the value.
+     * Skipped values are passed over in the raw input without being parsed where possible.
+     */
+    virtual std::unique_ptr<ReaderFrame> key(std::string_view str) { throw ReaderError("Unexpected key"); }
+    /**Read array elements straight from the raw input, bypassing the tokenizer.
+     * Called on an array frame after start_array, and after each number element, where the input
+     * supports it. See rapidjson_ext_detail::read_number_run for the arguments.
+     * Returns the number of bytes consumed, or 0 to receive the elements as usual.
+     */
+    virtual size_t read_elements(const char *text, size_t len, bool after_value) { return 0; }
+    /**String to receive the value's JSON text, for a frame that takes its value unparsed.
+     * Where the input supports it the value of an object key is captured straight from the raw
+     * input, and none of the value callbacks are called. Otherwise the frame is passed the
+     * value's events as usual. See make_json_reader(RawJson*).
+     */
+    virtual std::string *raw_text() { return nullptr; }
 };
 
+/**Ignores a value. The values of any keys are skipped, see ReaderFrame::key.*/
 class ReaderDiscard : public ReaderFrame
 {
 public:
@@ -55,7 +109,7 @@ public:
     virtual void value_int64(int64_t i) {}
     virtual void value_uint64(uint64_t i) {}
     virtual void value_double(double d) {}
-    virtual void value_string(const std::string &str) {}
+    virtual void value_string(std::string_view str) {}
     virtual std::unique_ptr<ReaderFrame> start_array()
     {
         if (in_array) return std::make_unique<ReaderDiscard>();
@@ -68,14 +122,16 @@ public:
     }
     virtual std::unique_ptr<ReaderFrame> start_object()
     {
-        return std::make_unique<ReaderDiscard>();
+        // Array elements get their own frame, otherwise this frame is the object
+        if (in_array) return std::make_unique<ReaderDiscard>();
+        return nullptr;
     }
     virtual void end_object()
     {
     }
-    virtual std::unique_ptr<ReaderFrame> key(const std::string &str)
+    virtual std::unique_ptr<ReaderFrame> key(std::string_view str)
     {
-        return std::make_unique<ReaderDiscard>();
+        return nullptr;
     }
 
     bool in_array;
@@ -138,16 +194,124 @@ class ReaderString : public ReaderFrame
 {
 public:
     explicit ReaderString(std::string *out) : out(out) {}
-    virtual void value_string(const std::string &str) { *out = str; }
+    virtual void value_string(std::string_view str) { out->assign(str.data(), str.size()); }
 private:
     std::string *out;
 };
 
+inline std::unique_ptr<ReaderFrame> make_json_reader(char *p) { return std::make_unique<ReaderInt<char>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned char *p) { return std::make_unique<ReaderInt<unsigned char>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(short *p) { return std::make_unique<ReaderInt<short>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned short *p) { return std::make_unique<ReaderInt<unsigned short>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(int *p) { return std::make_unique<ReaderInt<int>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned *p) { return std::make_unique<ReaderInt<unsigned>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(long *p) { return std::make_unique<ReaderInt<long>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned long *p) { return std::make_unique<ReaderInt<unsigned long>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(long long *p) { return std::make_unique<ReaderInt<long long>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned long long *p) { return std::make_unique<ReaderInt<unsigned long long>>(p); }
+
+inline std::unique_ptr<ReaderFrame> make_json_reader(float *p) { return std::make_unique<ReaderFloat<float>>(p); }
+inline std::unique_ptr<ReaderFrame> make_json_reader(double *p) { return std::make_unique<ReaderFloat<double>>(p); }
+
+inline std::unique_ptr<ReaderFrame> make_json_reader(bool *p) { return std::make_unique<ReaderBool>(p); }
+
+inline std::unique_ptr<ReaderFrame> make_json_reader(std::string *p) { return std::make_unique<ReaderString>(p); }
+
+/**Reader capturing a value as JSON text, without building anything from it.
+ *
+ * The value of an object key is copied straight from the input, whitespace and all, while it is
+ * skipped over as for ReaderFrame::key, then validated as strictly as any other value. A top
+ * level value or an array element, or any value from an input that cannot be skipped, such as
+ * in-situ and CBOR parsing, is instead rebuilt from its parse events as compact JSON.
+ */
+std::unique_ptr<ReaderFrame> make_json_reader(RawJson *p);
+
+/**Expected length of an array, learned from the arrays read before it.
+ *
+ * A list reader given a hint reserves that many elements before reading, then records the
+ * actual length. Repeated parses of similarly shaped documents then make one allocation per
+ * array, rather than growing it a step at a time. ReaderFields keeps a hint for each of its list
+ * fields, so every position in a schema learns its own length.
+ *
+ * The hint follows increases at once, but decreases only gradually, so an occasional short array
+ * does not throw away the capacity learned from the rest. It may be shared between threads.
+ */
+class ReaderSizeHint
+{
+public:
+    /**@param initial Length to reserve before any array has been read.*/
+    explicit ReaderSizeHint(size_t initial = 0) : length(initial) {}
+
+    ReaderSizeHint(const ReaderSizeHint &) = delete;
+    ReaderSizeHint& operator = (const ReaderSizeHint &) = delete;
+
+    /**Number of elements to reserve.*/
+    size_t get()const { return length.load(std::memory_order_relaxed); }
+    /**Record the length of an array that was read.*/
+    void update(size_t n)
+    {
+        size_t prev = get();
+        size_t next = n >= prev ? n : prev - (prev - n) / 4;
+        if (next != prev) length.store(next, std::memory_order_relaxed);
+    }
+private:
+    std::atomic<size_t> length;
+};
+
+template<class T, typename std::enable_if<rapidjson_ext_detail::is_list<T>::value>::type * = nullptr>
+std::unique_ptr<ReaderFrame> make_json_reader(T *list);
+/**List reader that reserves space according to hint, which must outlive it.*/
+template<class T, typename std::enable_if<rapidjson_ext_detail::is_list<T>::value>::type * = nullptr>
+std::unique_ptr<ReaderFrame> make_json_reader(T *list, ReaderSizeHint *hint);
+
+/**Base for object readers, which implement key.
+ *
+ * Readers with required keys give each one a bit, call mark_seen as they read them, and call
+ * check_required from end_object:
+ *
+ *     virtual std::unique_ptr<ReaderFrame> key(std::string_view str)override
+ *     {
+ *         if (str == "id") { mark_seen(0); return make_json_reader(&out->id); }
+ *         ...
+ *     }
+ *     virtual void end_object()override { check_required(1, { "id" }); }
+ */
 class ReaderObject : public ReaderFrame
 {
 public:
-    virtual std::unique_ptr<ReaderFrame> start_object()override { return nullptr; }
+    ReaderObject() : seen(0) {}
+
+    virtual std::unique_ptr<ReaderFrame> start_object()override
+    {
+        seen = 0;
+        return nullptr;
+    }
     virtual void end_object()override {}
+protected:
+    /**Record that the required key with bit index bit, below 64, was read.*/
+    void mark_seen(unsigned bit) { seen |= (uint64_t)1 << bit; }
+    /**Throw a ReaderError unless the key of every bit in mask was seen.
+     * names[i] is the key of bit i, used for the message.
+     */
+    void check_required(uint64_t mask, std::initializer_list<const char*> names = {})const
+    {
+        if ((seen & mask) != mask) missing_key(mask & ~seen, names);
+    }
+
+    /**Bits of the required keys read so far.*/
+    uint64_t seen;
+private:
+    [[noreturn]] static void missing_key(uint64_t missing, std::initializer_list<const char*> names)
+    {
+        size_t bit = 0;
+        while (!(missing & 1))
+        {
+            missing >>= 1;
+            ++bit;
+        }
+        if (bit < names.size()) throw ReaderError(std::string("Missing key ") + names.begin()[bit]);
+        throw ReaderError("Missing key");
+    }
 };
 
 template<class T>
@@ -155,8 +319,9 @@ class ReaderList : public ReaderFrame
 {
 public:
     typedef typename T::value_type value_type;
-    ReaderList(T *list)
-        : list(list), in_array(false), tmp_value(), value_reader(make_json_reader(&tmp_value))
+    explicit ReaderList(T *list, ReaderSizeHint *hint = nullptr)
+        : list(list), hint(hint), start_size(0), in_array(false), tmp_value(),
+        value_reader(make_json_reader(&tmp_value))
     {
     }
 
@@ -166,6 +331,11 @@ public:
         if (!in_array)
         {
             in_array = true;
+            if (hint)
+            {
+                start_size = list->size();
+                rapidjson_ext_detail::reserve_more(*list, hint->get());
+            }
             return nullptr;
         }
         else
@@ -178,6 +348,7 @@ public:
     {
         if (in_array) in_array = false;
         else throw std::runtime_error("Unexpected array end");
+        if (hint) hint->update(list->size() - start_size);
     }
     virtual std::unique_ptr<ReaderFrame> start_object()override
     {
@@ -187,7 +358,15 @@ public:
     virtual void end_object()override
     {
     }
-
+    virtual size_t read_elements(const char *text, size_t len, bool after_value)override
+    {
+        if constexpr (rapidjson_ext_detail::is_bulk_number<value_type>::value)
+        {
+            if (!in_array) return 0;
+            return rapidjson_ext_detail::read_number_run(*list, text, len, after_value);
+        }
+        return 0;
+    }
 
     virtual void value_null()override
     {
@@ -231,7 +410,7 @@ public:
         value_reader->value_double(d);
         list->push_back(tmp_value);
     }
-    virtual void value_string(const std::string &str)
+    virtual void value_string(std::string_view str)
     {
         if (!in_array) throw std::runtime_error("Expected array");
         value_reader->value_string(str);
@@ -239,53 +418,66 @@ public:
     }
 private:
     T *list;
+    ReaderSizeHint *hint;
+    size_t start_size;
     bool in_array;
     value_type tmp_value;
-    decltype(make_json_reader(std::add_pointer<value_type>::type())) value_reader;
+    decltype(make_json_reader(typename std::add_pointer<value_type>::type())) value_reader;
 };
 
-
-namespace rapidjson_ext_detail
-{
-    // Enable argument dependent lookup
-    using std::begin;
-    using std::end;
-
-    /**Implementation for is_iterable*/
-    template<class T>
-    auto is_list_impl(int) -> decltype(
-        std::declval<T>().push_back(std::declval<typename T::value_type>()),
-        std::true_type{}
-    );
-    /**Not iterable. ... is less specific than (int)*/
-    template<class T>
-    std::false_type is_list_impl(...);
-
-    /**Consider an object a list if it has a push_back(value_type)*/
-    template <class T> struct is_list : public decltype(is_list_impl<T>(0)) {};
-}
-
-inline std::unique_ptr<ReaderFrame> make_json_reader(char *p) { return std::make_unique<ReaderInt<char>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned char *p) { return std::make_unique<ReaderInt<unsigned char>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(short *p) { return std::make_unique<ReaderInt<short>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned short *p) { return std::make_unique<ReaderInt<unsigned short>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(int *p) { return std::make_unique<ReaderInt<int>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned *p) { return std::make_unique<ReaderInt<unsigned>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(long *p) { return std::make_unique<ReaderInt<long>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned long *p) { return std::make_unique<ReaderInt<unsigned long>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(long long *p) { return std::make_unique<ReaderInt<long long>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(unsigned long long *p) { return std::make_unique<ReaderInt<unsigned long long>>(p); }
-
-inline std::unique_ptr<ReaderFrame> make_json_reader(float *p) { return std::make_unique<ReaderFloat<float>>(p); }
-inline std::unique_ptr<ReaderFrame> make_json_reader(double *p) { return std::make_unique<ReaderFloat<double>>(p); }
-
-inline std::unique_ptr<ReaderFrame> make_json_reader(bool *p) { return std::make_unique<ReaderBool>(p); }
-
-inline std::unique_ptr<ReaderFrame> make_json_reader(std::string *p) { return std::make_unique<ReaderString>(p); }
-
-template<class T, typename std::enable_if<rapidjson_ext_detail::is_list<T>::value>::type * = nullptr>
+template<class T, typename std::enable_if<rapidjson_ext_detail::is_list<T>::value>::type *>
 std::unique_ptr<ReaderFrame> make_json_reader(T *list)
 {
     return std::make_unique<ReaderList<T>>(list);
 }
+template<class T, typename std::enable_if<rapidjson_ext_detail::is_list<T>::value>::type *>
+std::unique_ptr<ReaderFrame> make_json_reader(T *list, ReaderSizeHint *hint)
+{
+    return std::make_unique<ReaderList<T>>(list, hint);
+}
 
+template<class T>
+void read_json(const std::string &str, T *p)
+{
+    read_json(str, make_json_reader(p));
+}
+template<class T>
+void read_json(const char *str, size_t len, T *p)
+{
+    read_json(str, len, make_json_reader(p));
+}
+template<class T>
+void read_json(std::istream &is, T *p, size_t buffer_size = READ_JSON_BUFFER_SIZE)
+{
+    read_json(is, make_json_reader(p), buffer_size);
+}
+template<class T>
+void read_json_fd(int fd, T *p, size_t buffer_size = READ_JSON_BUFFER_SIZE)
+{
+    read_json_fd(fd, make_json_reader(p), buffer_size);
+}
+template<class T>
+void read_json_file(const std::string &path, T *p)
+{
+    read_json_file(path, make_json_reader(p));
+}
+template<class T>
+void read_cbor(const char *data, size_t len, T *p)
+{
+    read_cbor(data, len, make_json_reader(p));
+}
+template<class T>
+void read_cbor(const std::string &data, T *p)
+{
+    read_cbor(data, make_json_reader(p));
+}
+template<class T>
+void read_json_insitu(char *str, T *p)
+{
+    read_json_insitu(str, make_json_reader(p));
+}
+template<class T>
+void read_json_insitu(std::string &str, T *p)
+{
+    read_json_insitu(str, make_json_reader(p));
+}
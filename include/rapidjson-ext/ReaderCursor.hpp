@@ -0,0 +1,95 @@
+#pragma once
+#include "Reader.hpp"
+#include <iterator>
+#include <memory>
+
+class ReaderCursorFrame;
+
+/**Pull parser over the elements of a top level JSON array.
+ *
+ * Each call to next parses just one more element, then suspends the parser, so memory use
+ * depends on the size of an element rather than the length of the array. JsonArrayCursor
+ * provides the element type.
+ *
+ * The input must outlive the cursor. Frames are allocated from an arena owned by the cursor.
+ */
+class ReaderArrayCursor
+{
+public:
+    /**Cursor over a JSON document held in memory.*/
+    ReaderArrayCursor(const char *str, size_t len);
+    /**Cursor over a JSON document read from is, buffer_size bytes at a time.*/
+    ReaderArrayCursor(std::istream &is, size_t buffer_size);
+    virtual ~ReaderArrayCursor();
+
+    ReaderArrayCursor(const ReaderArrayCursor &) = delete;
+    ReaderArrayCursor& operator = (const ReaderArrayCursor &) = delete;
+
+    /**Parse the next element. Returns false at the end of the array.*/
+    bool next();
+protected:
+    /**Clear the element slot, before an element is read into it.*/
+    virtual void clear_element() = 0;
+    /**Frame reading an element into the slot. Called for each object or array element, and
+     * once for the first scalar element, whose frame is then reused for the rest.
+     */
+    virtual std::unique_ptr<ReaderFrame> element_reader() = 0;
+private:
+    friend class ReaderCursorFrame;
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+/**ReaderArrayCursor reading each element into a single reused T, with make_json_reader.
+ *
+ *     JsonArrayCursor<Record> cursor(file);
+ *     for (auto &record : cursor) process(record);
+ */
+template<class T>
+class JsonArrayCursor : public ReaderArrayCursor
+{
+public:
+    class iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T *pointer;
+        typedef T &reference;
+
+        explicit iterator(JsonArrayCursor *cursor = nullptr) : cursor(cursor) {}
+
+        T &operator *()const { return cursor->value(); }
+        T *operator ->()const { return &cursor->value(); }
+        iterator &operator ++()
+        {
+            if (!cursor->next()) cursor = nullptr;
+            return *this;
+        }
+        bool operator == (const iterator &other)const { return cursor == other.cursor; }
+        bool operator != (const iterator &other)const { return cursor != other.cursor; }
+    private:
+        JsonArrayCursor *cursor;
+    };
+
+    JsonArrayCursor(const char *str, size_t len) : ReaderArrayCursor(str, len), slot() {}
+    explicit JsonArrayCursor(const std::string &str) : ReaderArrayCursor(str.data(), str.size()), slot() {}
+    /**The input is not copied, so may not be a temporary.*/
+    explicit JsonArrayCursor(std::string &&str) = delete;
+    explicit JsonArrayCursor(std::istream &is, size_t buffer_size = READ_JSON_BUFFER_SIZE)
+        : ReaderArrayCursor(is, buffer_size), slot()
+    {}
+
+    /**The current element, valid until the next call to next.*/
+    T &value() { return slot; }
+
+    /**Advances to the first element, so may only be called once.*/
+    iterator begin() { return next() ? iterator(this) : iterator(); }
+    iterator end() { return iterator(); }
+protected:
+    virtual void clear_element()override { slot = T(); }
+    virtual std::unique_ptr<ReaderFrame> element_reader()override { return make_json_reader(&slot); }
+private:
+    T slot;
+};
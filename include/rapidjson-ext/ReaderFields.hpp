@@ -0,0 +1,329 @@
+#pragma once
+#include "Reader.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**Perfect hash table from a fixed set of keys to their index.
+ *
+ * build searches for a hash function that puts every key in its own slot, first trying one
+ * that only looks at the length and the first, middle and last characters, then a hash of
+ * the whole key. A lookup is then a single hash and one comparison, however many keys there are.
+ *
+ * The table is built at run time, once for each ReaderFields or ReaderStaticFields instance,
+ * generally on first use of a function local static, rather than generated at compile time. A
+ * ReaderFields entry makes its member's reader through a type erased, heap allocated maker, so
+ * the table as a whole cannot be a constant expression. The search for a hash can also try
+ * thousands of seeds on a wide table, which would exceed the compilers' constexpr evaluation
+ * limits. Only the build runs at run time. Lookups cost the same as from a generated table.
+ */
+class ReaderKeyTable
+{
+public:
+    static const size_t npos = (size_t)-1;
+
+    ReaderKeyTable() : full_hash(false), multiplier(0), shift(32) {}
+
+    /**Build the table for keys. Throws std::invalid_argument on duplicate keys.*/
+    void build(const std::vector<std::pair<const char*, size_t>> &keys);
+
+    /**Index of a key, or npos.*/
+    size_t find(const char *key, size_t len)const
+    {
+        if (slots.empty()) return npos;
+        auto &slot = slots[hash(key, len, full_hash, multiplier, shift)];
+        if (slot.len == len && std::memcmp(slot.key, key, len) == 0) return slot.index;
+        return npos;
+    }
+private:
+    struct Slot
+    {
+        const char *key;
+        size_t len;
+        size_t index;
+    };
+
+    static uint32_t hash(const char *key, size_t len, bool full_hash, uint32_t multiplier, unsigned shift)
+    {
+        uint32_t x;
+        if (full_hash)
+        {
+            // FNV-1a
+            x = 2166136261u;
+            for (size_t i = 0; i < len; ++i) x = (x ^ (unsigned char)key[i]) * 16777619u;
+        }
+        else if (len == 0) x = 0;
+        else
+        {
+            x = (uint32_t)len ^
+                ((uint32_t)(unsigned char)key[0] << 8) ^
+                ((uint32_t)(unsigned char)key[len / 2] << 16) ^
+                ((uint32_t)(unsigned char)key[len - 1] << 24);
+        }
+        return (x * multiplier) >> shift;
+    }
+
+    std::vector<Slot> slots;
+    bool full_hash;
+    uint32_t multiplier;
+    unsigned shift;
+};
+
+/**Constraints on a field of a ReaderFields table, checked as the object is parsed.
+ *
+ *     { "id", &MyObject::id, json_required() },
+ *     { "port", &MyObject::port, json_range(1, 65535).required() }
+ */
+class ReaderFieldRule
+{
+public:
+    ReaderFieldRule() : is_required(false), has_range(false), min(0), max(0) {}
+
+    /**The key must be present. Checked at the end of the object.*/
+    ReaderFieldRule &required()
+    {
+        is_required = true;
+        return *this;
+    }
+    /**The value must be a number in [min, max]. Only for numeric members.
+     * For integer members the bounds must be integers the member can hold.
+     */
+    ReaderFieldRule &range(double min, double max)
+    {
+        has_range = true;
+        this->min = min;
+        this->max = max;
+        return *this;
+    }
+
+    bool is_required;
+    bool has_range;
+    double min;
+    double max;
+};
+
+inline ReaderFieldRule json_required() { return ReaderFieldRule().required(); }
+inline ReaderFieldRule json_range(double min, double max) { return ReaderFieldRule().range(min, max); }
+
+/**Reader for a number that must be in [min, max], checked before it is stored.
+ * For integer members the bounds are of the member's type, so integers are compared exactly.
+ */
+template<class M>
+class ReaderRange : public ReaderFrame
+{
+public:
+    typedef typename std::conditional<std::is_integral<M>::value, M, double>::type Bound;
+
+    ReaderRange(M *out, Bound min, Bound max) : reader(out), min(min), max(max) {}
+
+    virtual void value_int(int i)override { check(i); reader.value_int(i); }
+    virtual void value_uint(unsigned i)override { check(i); reader.value_uint(i); }
+    virtual void value_int64(int64_t i)override { check(i); reader.value_int64(i); }
+    virtual void value_uint64(uint64_t i)override { check(i); reader.value_uint64(i); }
+    virtual void value_double(double d)override { check(d); reader.value_double(d); }
+private:
+    template<class V>
+    void check(V x)const
+    {
+        bool in_range;
+        if constexpr (std::is_integral<M>::value && std::is_integral<V>::value)
+            in_range = less_equal(min, x) && less_equal(x, max);
+        else in_range = (double)x >= (double)min && (double)x <= (double)max; // Also false for NaN
+        if (!in_range) throw ReaderError("Out of range");
+    }
+    /**a <= b for integers of any signedness.*/
+    template<class A, class B>
+    static bool less_equal(A a, B b)
+    {
+        if constexpr (std::is_signed<A>::value == std::is_signed<B>::value) return a <= b;
+        else if constexpr (std::is_signed<A>::value) return a < 0 || (typename std::make_unsigned<A>::type)a <= b;
+        else return b >= 0 && a <= (typename std::make_unsigned<B>::type)b;
+    }
+
+    typename std::conditional<std::is_floating_point<M>::value, ReaderFloat<M>, ReaderInt<M>>::type reader;
+    Bound min;
+    Bound max;
+};
+
+/**One entry in a ReaderFields table, mapping a JSON key to a member of T.*/
+template<class T>
+class ReaderField
+{
+public:
+    template<size_t N, class M>
+    ReaderField(const char (&name)[N], M T::*member, const ReaderFieldRule &rule = ReaderFieldRule())
+        : name(name), len(N - 1), required(rule.is_required), required_bit(0),
+        maker(std::make_shared<Maker<M>>(member, rule))
+    {}
+
+    const char *name;
+    size_t len;
+    bool required;
+    /**Bit of this field in ReaderObject::seen, or 0 if optional.
+     * Assigned by ReaderFields.
+     */
+    uint64_t required_bit;
+
+    /**Create the reader for this field of obj.*/
+    std::unique_ptr<ReaderFrame> make(T *obj)const { return maker->make(obj); }
+private:
+    struct MakerBase
+    {
+        virtual ~MakerBase() {}
+        virtual std::unique_ptr<ReaderFrame> make(T *obj)const = 0;
+    };
+    template<class M> struct Maker : public MakerBase
+    {
+        typedef typename std::conditional<std::is_integral<M>::value, M, double>::type Bound;
+
+        Maker(M T::*member, const ReaderFieldRule &rule)
+            : member(member), hint(), has_range(rule.has_range), min(), max()
+        {
+            if (!has_range) return;
+            if (!(std::is_arithmetic<M>::value && !std::is_same<M, bool>::value))
+                throw std::invalid_argument("Range on a non-numeric field");
+            min = bound(rule.min);
+            max = bound(rule.max);
+        }
+        /**x as the member's type, for an exact comparison with integers.*/
+        static Bound bound(double x)
+        {
+            if constexpr (std::is_integral<M>::value)
+            {
+                // Integers in [lowest, limit) convert exactly
+                const double limit = std::ldexp(1.0, std::numeric_limits<M>::digits);
+                const double lowest = std::is_signed<M>::value ? -limit : 0.0;
+                if (!(x >= lowest && x < limit && std::trunc(x) == x))
+                    throw std::invalid_argument("Range bound not representable by the field");
+                return (M)x;
+            }
+            else return x;
+        }
+        virtual std::unique_ptr<ReaderFrame> make(T *obj)const override
+        {
+            if constexpr (std::is_arithmetic<M>::value && !std::is_same<M, bool>::value)
+            {
+                if (has_range) return std::make_unique<ReaderRange<M>>(&(obj->*member), min, max);
+            }
+            return make_field(&(obj->*member), rapidjson_ext_detail::uses_size_hint<M>());
+        }
+        std::unique_ptr<ReaderFrame> make_field(M *p, std::true_type)const
+        {
+            return make_json_reader(p, &hint);
+        }
+        std::unique_ptr<ReaderFrame> make_field(M *p, std::false_type)const
+        {
+            return make_json_reader(p);
+        }
+        M T::*member;
+        /**Length of this field's arrays, if it is a list.*/
+        mutable ReaderSizeHint hint;
+        bool has_range;
+        Bound min;
+        Bound max;
+    };
+    std::shared_ptr<const MakerBase> maker;
+};
+
+/**Declarative description of the fields of an object, used to create a ReaderFieldsObject.
+ *
+ * Generally a single static instance is declared for each type in its make_json_reader overload:
+ *
+ *     inline std::unique_ptr<ReaderFrame> make_json_reader(MyObject *p)
+ *     {
+ *         static const ReaderFields<MyObject> fields = {
+ *             { "x", &MyObject::x },
+ *             { "str", &MyObject::str }
+ *         };
+ *         return make_json_fields_reader(p, fields);
+ *     }
+ *
+ * Fields may have a ReaderFieldRule. Each required field is given a bit, and each object reader
+ * sets the bits of the keys it reads, so checking that none are missing at the end of the object
+ * is a single comparison. Up to 64 fields may be required.
+ */
+template<class T>
+class ReaderFields
+{
+public:
+    /**@param ignore_unknown Discard keys not in the table rather than throwing a ReaderError.*/
+    ReaderFields(std::initializer_list<ReaderField<T>> fields, bool ignore_unknown = false)
+        : fields(fields), ignore_unknown(ignore_unknown), required_mask(0)
+    {
+        std::vector<std::pair<const char*, size_t>> keys;
+        size_t required_count = 0;
+        for (auto &field : this->fields)
+        {
+            keys.emplace_back(field.name, field.len);
+            if (!field.required) continue;
+            if (required_count == 64) throw std::invalid_argument("More than 64 required fields");
+            field.required_bit = (uint64_t)1 << required_count++;
+            required_mask |= field.required_bit;
+        }
+        table.build(keys);
+    }
+
+    /**Find the field for a key, or null.*/
+    const ReaderField<T> *find(const char *key, size_t len)const
+    {
+        auto i = table.find(key, len);
+        return i == ReaderKeyTable::npos ? nullptr : &fields[i];
+    }
+
+    /**Throw a ReaderError for the first required field whose bit is not in seen.*/
+    [[noreturn]] void missing(uint64_t seen)const
+    {
+        for (auto &field : fields)
+        {
+            if (field.required_bit & ~seen) throw ReaderError("Missing key " + std::string(field.name, field.len));
+        }
+        throw ReaderError("Missing key");
+    }
+
+    std::vector<ReaderField<T>> fields;
+    bool ignore_unknown;
+    /**Bits of all the required fields.*/
+    uint64_t required_mask;
+private:
+    ReaderKeyTable table;
+};
+
+/**Object reader dispatching keys through a ReaderFields table.*/
+template<class T>
+class ReaderFieldsObject : public ReaderObject
+{
+public:
+    ReaderFieldsObject(T *out, const ReaderFields<T> &fields) : out(out), fields(fields) {}
+
+    virtual void end_object()override
+    {
+        if (seen != fields.required_mask) fields.missing(seen);
+    }
+    virtual std::unique_ptr<ReaderFrame> key(std::string_view str)override
+    {
+        auto field = fields.find(str.data(), str.size());
+        if (field)
+        {
+            seen |= field->required_bit;
+            return field->make(out);
+        }
+        else if (fields.ignore_unknown) return nullptr;
+        else throw ReaderError("Unknown key " + std::string(str));
+    }
+private:
+    T *out;
+    const ReaderFields<T> &fields;
+};
+
+template<class T>
+std::unique_ptr<ReaderFrame> make_json_fields_reader(T *p, const ReaderFields<T> &fields)
+{
+    return std::make_unique<ReaderFieldsObject<T>>(p, fields);
+}
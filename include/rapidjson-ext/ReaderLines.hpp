@@ -0,0 +1,180 @@
+#pragma once
+#include "Reader.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+/**Receives the documents of a newline delimited JSON (NDJSON) input parsed by read_json_lines,
+ * or the elements of an array parsed by read_json_array_parallel.
+ *
+ * The input is split on line or element boundaries into chunks, and each chunk is parsed by one
+ * worker thread in order. document and end_document are called on that thread, so calls for
+ * different chunks run concurrently.
+ */
+class ReaderLinesHandler
+{
+public:
+    virtual ~ReaderLinesHandler() {}
+
+    /**Called once, before any parsing, with the number of chunks.*/
+    virtual void start(size_t chunks) {}
+    /**Root frame for the next document in chunk.*/
+    virtual std::unique_ptr<ReaderFrame> document(size_t chunk) = 0;
+    /**Called after each document in chunk is complete.*/
+    virtual void end_document(size_t chunk) {}
+};
+
+/**Parse newline delimited JSON, one document per line, in parallel.
+ * Blank lines are skipped, and a document spanning several lines is an error. Uses up to threads
+ * worker threads, or one per core if 0.
+ * If parsing fails, the error from the earliest failing chunk is rethrown once all workers stop.
+ */
+void read_json_lines(const char *str, size_t len, ReaderLinesHandler &handler, unsigned threads = 0);
+void read_json_lines(const std::string &str, ReaderLinesHandler &handler, unsigned threads = 0);
+/**Parse a memory mapped newline delimited JSON file in parallel.*/
+void read_json_lines_file(const std::string &path, ReaderLinesHandler &handler, unsigned threads = 0);
+
+/**Parse a JSON document whose top level value is an array, in parallel, passing each element
+ * to handler as a document.
+ *
+ * A pre-scan that tracks only strings and bracket depth splits the elements into chunks of
+ * roughly equal size, each parsed by one worker with its own frame stack. The pre-scan is
+ * sequential, but much faster than parsing. Uses up to threads worker threads, or one per core
+ * if 0. If parsing fails, the error from the earliest failing chunk is rethrown once all workers
+ * stop.
+ */
+void read_json_array_parallel(const char *str, size_t len, ReaderLinesHandler &handler, unsigned threads = 0);
+void read_json_array_parallel(const std::string &str, ReaderLinesHandler &handler, unsigned threads = 0);
+/**Parse a memory mapped JSON file whose top level value is an array, in parallel.*/
+void read_json_array_parallel_file(const std::string &path, ReaderLinesHandler &handler, unsigned threads = 0);
+
+/**ReaderLinesHandler appending each document to a vector, in input order.
+ * Each chunk is read into its own vector, and these are moved onto the output by finish.
+ */
+template<class T>
+class ReaderLinesVector : public ReaderLinesHandler
+{
+public:
+    explicit ReaderLinesVector(std::vector<T> *out) : out(out) {}
+
+    virtual void start(size_t chunks)override
+    {
+        this->chunks.clear();
+        this->chunks.resize(chunks);
+    }
+    virtual std::unique_ptr<ReaderFrame> document(size_t chunk)override
+    {
+        chunks[chunk].emplace_back();
+        return make_json_reader(&chunks[chunk].back());
+    }
+
+    /**Append the parsed documents to the output vector.*/
+    void finish()
+    {
+        size_t total = out->size();
+        for (auto &chunk : chunks) total += chunk.size();
+        out->reserve(total);
+        for (auto &chunk : chunks)
+        {
+            for (auto &value : chunk) out->push_back(std::move(value));
+        }
+        chunks.clear();
+    }
+private:
+    std::vector<T> *out;
+    std::vector<std::vector<T>> chunks;
+};
+
+/**ReaderLinesHandler passing each document to a callback as soon as it is parsed.
+ * The callback is called concurrently from the worker threads, in no particular order, with a
+ * T&& it may move from.
+ */
+template<class T, class F>
+class ReaderLinesCallback : public ReaderLinesHandler
+{
+public:
+    explicit ReaderLinesCallback(F callback) : callback(std::move(callback)) {}
+
+    virtual void start(size_t chunks)override
+    {
+        values.clear();
+        values.resize(chunks);
+    }
+    virtual std::unique_ptr<ReaderFrame> document(size_t chunk)override
+    {
+        values[chunk].value = T();
+        return make_json_reader(&values[chunk].value);
+    }
+    virtual void end_document(size_t chunk)override
+    {
+        callback(std::move(values[chunk].value));
+    }
+private:
+    /**Padded so that workers do not share cache lines.*/
+    struct alignas(64) Slot
+    {
+        T value;
+    };
+
+    F callback;
+    std::vector<Slot> values;
+};
+
+/**Parse newline delimited JSON in parallel, appending each document to out in input order.*/
+template<class T>
+void read_json_lines(const char *str, size_t len, std::vector<T> &out, unsigned threads = 0)
+{
+    ReaderLinesVector<T> handler(&out);
+    read_json_lines(str, len, handler, threads);
+    handler.finish();
+}
+template<class T>
+void read_json_lines(const std::string &str, std::vector<T> &out, unsigned threads = 0)
+{
+    read_json_lines(str.data(), str.size(), out, threads);
+}
+template<class T>
+void read_json_lines_file(const std::string &path, std::vector<T> &out, unsigned threads = 0)
+{
+    ReaderLinesVector<T> handler(&out);
+    read_json_lines_file(path, handler, threads);
+    handler.finish();
+}
+
+/**Parse a top level JSON array in parallel, appending each element to out in order.
+ * The result is the same as read_json into a std::vector<T>. On error out is left unchanged.
+ */
+template<class T>
+void read_json_array_parallel(const char *str, size_t len, std::vector<T> &out, unsigned threads = 0)
+{
+    ReaderLinesVector<T> handler(&out);
+    read_json_array_parallel(str, len, handler, threads);
+    handler.finish();
+}
+template<class T>
+void read_json_array_parallel(const std::string &str, std::vector<T> &out, unsigned threads = 0)
+{
+    read_json_array_parallel(str.data(), str.size(), out, threads);
+}
+template<class T>
+void read_json_array_parallel_file(const std::string &path, std::vector<T> &out, unsigned threads = 0)
+{
+    ReaderLinesVector<T> handler(&out);
+    read_json_array_parallel_file(path, handler, threads);
+    handler.finish();
+}
+
+/**Parse newline delimited JSON in parallel, calling callback(T&&) for each document.
+ * The callback is called from the worker threads, concurrently and out of order.
+ */
+template<class T, class F>
+void read_json_lines_unordered(const char *str, size_t len, F callback, unsigned threads = 0)
+{
+    ReaderLinesCallback<T, F> handler(std::move(callback));
+    read_json_lines(str, len, handler, threads);
+}
+template<class T, class F>
+void read_json_lines_unordered(const std::string &str, F callback, unsigned threads = 0)
+{
+    read_json_lines_unordered<T>(str.data(), str.size(), std::move(callback), threads);
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+/**Parsing runs of numbers straight from the raw input into a list, for the arrays of numbers
+ * read by ReaderList and read_json_value, bypassing the tokenizer.
+ *
+ * Only the common forms are handled: integers of up to 19 digits, and decimals of up to 15
+ * digits scaled by at most 1e22, where a single multiplication or division is correctly
+ * rounded. These give the same values as rapidjson. Anything else ends the run, leaving that
+ * element to the tokenizer, which also reports any syntax error.
+ */
+namespace rapidjson_ext_detail
+{
+    /**Numeric types read in runs. bool is read from true and false.*/
+    template<class T> struct is_bulk_number : public std::integral_constant<bool,
+        std::is_arithmetic<T>::value && !std::is_same<T, bool>::value> {};
+
+    /**A number scanned by scan_number.*/
+    struct ScannedNumber
+    {
+        /**Integer, with the magnitude in u.*/
+        bool integer;
+        bool negative;
+        uint64_t u;
+        double d;
+    };
+
+    inline bool is_json_space(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+    inline const char *skip_json_space(const char *p, const char *end)
+    {
+        while (p != end && is_json_space(*p)) ++p;
+        return p;
+    }
+
+    /**True if all 8 bytes of v are ASCII digits.*/
+    inline bool is_eight_digits(uint64_t v)
+    {
+        return ((v & 0xF0F0F0F0F0F0F0F0ull) |
+            (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+    }
+    /**Value of 8 ASCII digits loaded little endian, so the first digit is in the lowest byte.*/
+    inline uint32_t parse_eight_digits(uint64_t v)
+    {
+        v -= 0x3030303030303030ull;
+        v = v * 10 + (v >> 8);
+        v = (((v & 0x000000FF000000FFull) * 0x000F424000000064ull) +
+            (((v >> 16) & 0x000000FF000000FFull) * 0x0000271000000001ull)) >> 32;
+        return (uint32_t)v;
+    }
+    inline bool little_endian()
+    {
+        const uint16_t x = 1;
+        return *(const unsigned char*)&x == 1;
+    }
+
+    /**Append the digits at p to x, 8 at a time where possible. Returns the end of the digits.*/
+    inline const char *scan_digits(const char *p, const char *end, uint64_t &x, int &count)
+    {
+        if (little_endian())
+        {
+            while (end - p >= 8)
+            {
+                uint64_t v;
+                std::memcpy(&v, p, 8);
+                if (!is_eight_digits(v)) break;
+                x = x * 100000000 + parse_eight_digits(v);
+                count += 8;
+                p += 8;
+                // Past 19 digits the caller gives up anyway, so stop before overflowing
+                if (count > 19) return p;
+            }
+        }
+        while (p != end && (unsigned)(*p - '0') < 10)
+        {
+            x = x * 10 + (unsigned)(*p - '0');
+            ++p;
+            if (++count > 19) return p;
+        }
+        return p;
+    }
+
+    /**Scan a number at p in one of the simple forms. Returns the end of it, or null.*/
+    inline const char *scan_number(const char *p, const char *end, ScannedNumber &out)
+    {
+        static const double POW10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        out.negative = p != end && *p == '-';
+        if (out.negative) ++p;
+        if (p == end || (unsigned)(*p - '0') >= 10) return nullptr;
+        // No leading zeros
+        if (*p == '0' && end - p > 1 && (unsigned)(p[1] - '0') < 10) return nullptr;
+
+        uint64_t x = 0;
+        int digits = 0;
+        p = scan_digits(p, end, x, digits);
+        if (digits > 19) return nullptr;
+        if (p == end || (*p != '.' && (*p | 0x20) != 'e'))
+        {
+            // rapidjson reads integers below INT64_MIN as doubles
+            if (out.negative && x > (uint64_t)1 << 63) return nullptr;
+            out.integer = true;
+            out.u = x;
+            return p;
+        }
+
+        int exponent = 0;
+        if (*p == '.')
+        {
+            const char *frac = ++p;
+            p = scan_digits(p, end, x, digits);
+            if (p == frac) return nullptr;
+            exponent = -(int)(p - frac);
+        }
+        if (p != end && (*p | 0x20) == 'e')
+        {
+            ++p;
+            bool negative_exponent = p != end && *p == '-';
+            if (p != end && (*p == '-' || *p == '+')) ++p;
+            uint64_t e = 0;
+            int e_digits = 0;
+            const char *start = p;
+            p = scan_digits(p, end, e, e_digits);
+            if (p == start || e_digits > 3) return nullptr;
+            exponent += negative_exponent ? -(int)e : (int)e;
+        }
+        if (digits > 15 || exponent < -22 || exponent > 22) return nullptr;
+        double d = (double)x;
+        d = exponent >= 0 ? d * POW10[exponent] : d / POW10[-exponent];
+        out.integer = false;
+        out.d = out.negative ? -d : d;
+        return p;
+    }
+
+    /**Throw the ReaderError of ReaderInt for a value that does not fit.*/
+    [[noreturn]] void throw_out_of_range();
+
+    /**Convert a scanned number as the ReaderInt and ReaderFloat frames would.
+     * Returns false for a decimal read into an integer, to leave the error to the usual path.
+     */
+    template<class T>
+    bool convert_number(const ScannedNumber &num, T &out)
+    {
+        if (!num.integer)
+        {
+            if constexpr (std::is_floating_point<T>::value)
+            {
+                out = (T)num.d;
+                return true;
+            }
+            return false;
+        }
+        if (num.negative)
+        {
+            int64_t i = (int64_t)(0 - num.u);
+            if constexpr (std::is_integral<T>::value)
+            {
+                if (i < (int64_t)std::numeric_limits<T>::min()) throw_out_of_range();
+            }
+            out = (T)i;
+        }
+        else
+        {
+            if constexpr (std::is_integral<T>::value)
+            {
+                if (num.u > (uint64_t)std::numeric_limits<T>::max()) throw_out_of_range();
+            }
+            out = (T)num.u;
+        }
+        return true;
+    }
+
+    /**Parse array elements from [text, text + len) into list, while they are simple numbers.
+     *
+     * text starts with the next element, or if after_value with a ',' and then the next element.
+     * Each element taken must be followed within text by whitespace, ',' or ']', so one cut off at
+     * the end of the text is left alone. Returns the number of bytes consumed, which stops just
+     * after the last element taken.
+     */
+    template<class List>
+    size_t read_number_run(List &list, const char *text, size_t len, bool after_value)
+    {
+        typedef typename List::value_type T;
+        const char *end = text + len;
+        const char *p = text;
+        while (true)
+        {
+            const char *q = p;
+            if (after_value)
+            {
+                q = skip_json_space(q, end);
+                if (q == end || *q != ',') break;
+                ++q;
+            }
+            q = skip_json_space(q, end);
+            ScannedNumber num;
+            q = scan_number(q, end, num);
+            if (!q || q == end || !(is_json_space(*q) || *q == ',' || *q == ']')) break;
+            T value;
+            if (!convert_number(num, value)) break;
+            list.push_back(value);
+            p = q;
+            after_value = true;
+        }
+        return (size_t)(p - text);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "Reader.hpp"
+#include <memory>
+
+/**Incremental reader for a JSON document that arrives in fragments, such as from a socket.
+ *
+ * Each feed parses as much of the document as the input so far allows, calling the frames
+ * just as read_json would, so values are available before the document is complete. Only an
+ * incomplete token at the end of a fragment is kept between calls, not the whole document.
+ *
+ *     JsonPushReader reader(&value);
+ *     while ((len = recv(fd, buffer, sizeof(buffer), 0)) > 0) reader.feed(buffer, len);
+ *     reader.finish();
+ *
+ * The frames are allocated from an arena owned by the reader. After feed or finish throws,
+ * the reader must not be used further.
+ */
+class JsonPushReader
+{
+public:
+    explicit JsonPushReader(std::unique_ptr<ReaderFrame> &&root);
+    template<class T> explicit JsonPushReader(T *p) : JsonPushReader(make_json_reader(p)) {}
+    ~JsonPushReader();
+
+    JsonPushReader(const JsonPushReader &) = delete;
+    JsonPushReader& operator = (const JsonPushReader &) = delete;
+
+    /**Parse the next len bytes of the document.*/
+    void feed(const char *data, size_t len);
+    /**Signal the end of the input. Throws if the document is incomplete.*/
+    void finish();
+    /**True once the top level value has been parsed.*/
+    bool done()const;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
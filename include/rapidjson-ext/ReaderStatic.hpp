@@ -0,0 +1,295 @@
+#pragma once
+#include "Reader.hpp"
+#include "ReaderFields.hpp"
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+/**Pull parser returning one JSON token at a time, for the read_json_static path.
+ *
+ * Values are read by read_json_value overloads selected at compile time from the type being
+ * read, which call next to pull the tokens they need. So unlike the ReaderFrame path there are
+ * no virtual calls, frame allocations or frame stack, and the code for simple types such as
+ * std::vector<int> or a flat struct can be inlined.
+ *
+ * A read_json_value overload is called with the reader on the first token of its value, and
+ * returns with the reader on the last token of it.
+ */
+class JsonPullReader
+{
+public:
+    enum class Token
+    {
+        none,
+        null_value,
+        bool_value,
+        /**A negative integer.*/
+        int_value,
+        /**A non-negative integer.*/
+        uint_value,
+        double_value,
+        string,
+        key,
+        start_object,
+        end_object,
+        start_array,
+        end_array
+    };
+
+    /**Reader over a JSON document held in memory, which must outlive it.*/
+    JsonPullReader(const char *str, size_t len);
+    /**Reader over a JSON document read from is, buffer_size bytes at a time.*/
+    JsonPullReader(std::istream &is, size_t buffer_size = READ_JSON_BUFFER_SIZE);
+    ~JsonPullReader();
+
+    JsonPullReader(const JsonPullReader &) = delete;
+    JsonPullReader& operator = (const JsonPullReader &) = delete;
+
+    /**Advance to the next token. Throws at the end of the document, or on a syntax error.*/
+    Token next();
+    /**The current token.*/
+    Token token()const { return current; }
+
+    bool bool_value()const { return b; }
+    int64_t int_value()const { return i; }
+    uint64_t uint_value()const { return u; }
+    double double_value()const { return d; }
+    /**Value of a string or key token, valid until the next call to next.*/
+    std::string_view string()const { return str; }
+
+    /**Throw a ReaderError unless the current token is t.*/
+    void expect(Token t)const
+    {
+        if (current != t) unexpected();
+    }
+    /**Throw a ReaderError for the current token, such as "Unexpected string".*/
+    [[noreturn]] void unexpected()const;
+
+    /**Skip a value. On a key token, the key's value is passed over in the raw input without
+     * being parsed, see ReaderFrame::key. Otherwise the current value is skipped.
+     */
+    void skip_value();
+    /**Call after the top level value. Throws unless the document is complete.*/
+    void finish();
+
+    /**Buffered input following the current token, for reading elements straight from the raw
+     * input as with ReaderFrame::read_elements.
+     */
+    std::string_view raw_input();
+    /**Consume n bytes of raw_input. If after_value is false, the current token must be the
+     * start_array just before them, and the reader is left as if on an element of the array.
+     */
+    void consume_raw(size_t n, bool after_value);
+private:
+    struct Impl;
+    struct Handler;
+    /**Impl is constructed in place, so reading from memory makes no allocation of its own.*/
+    static const size_t IMPL_SIZE = 64 * sizeof(void*);
+    alignas(std::max_align_t) char impl_storage[IMPL_SIZE];
+    Impl *impl;
+
+    Token current;
+    bool b;
+    int64_t i;
+    uint64_t u;
+    double d;
+    std::string_view str;
+};
+
+inline void read_json_value(JsonPullReader &reader, bool *out)
+{
+    reader.expect(JsonPullReader::Token::bool_value);
+    *out = reader.bool_value();
+}
+
+template<class T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type * = nullptr>
+void read_json_value(JsonPullReader &reader, T *out)
+{
+    if (reader.token() == JsonPullReader::Token::uint_value)
+    {
+        if (reader.uint_value() > (uint64_t)std::numeric_limits<T>::max()) throw ReaderError("Out of range");
+        *out = (T)reader.uint_value();
+    }
+    else if (reader.token() == JsonPullReader::Token::int_value)
+    {
+        if (reader.int_value() < (int64_t)std::numeric_limits<T>::min()) throw ReaderError("Out of range");
+        *out = (T)reader.int_value();
+    }
+    else reader.unexpected();
+}
+
+template<class T, typename std::enable_if<std::is_floating_point<T>::value>::type * = nullptr>
+void read_json_value(JsonPullReader &reader, T *out)
+{
+    switch (reader.token())
+    {
+    case JsonPullReader::Token::double_value: *out = (T)reader.double_value(); break;
+    case JsonPullReader::Token::uint_value: *out = (T)reader.uint_value(); break;
+    case JsonPullReader::Token::int_value: *out = (T)reader.int_value(); break;
+    default: reader.unexpected();
+    }
+}
+
+inline void read_json_value(JsonPullReader &reader, std::string *out)
+{
+    reader.expect(JsonPullReader::Token::string);
+    auto str = reader.string();
+    out->assign(str.data(), str.size());
+}
+
+template<class T, typename std::enable_if<rapidjson_ext_detail::is_list<T>::value>::type * = nullptr>
+void read_json_value(JsonPullReader &reader, T *list)
+{
+    reader.expect(JsonPullReader::Token::start_array);
+    if constexpr (rapidjson_ext_detail::is_bulk_number<typename T::value_type>::value)
+    {
+        // Runs of numbers are read straight from the input, and anything else through next
+        bool after_value = false;
+        while (true)
+        {
+            auto text = reader.raw_input();
+            size_t used = rapidjson_ext_detail::read_number_run(*list, text.data(), text.size(), after_value);
+            reader.consume_raw(used, after_value);
+            if (reader.next() == JsonPullReader::Token::end_array) break;
+            list->emplace_back();
+            read_json_value(reader, &list->back());
+            after_value = true;
+        }
+    }
+    else
+    {
+        while (reader.next() != JsonPullReader::Token::end_array)
+        {
+            list->emplace_back();
+            read_json_value(reader, &list->back());
+        }
+    }
+}
+/**Read a list, reserving space according to hint, see ReaderSizeHint.*/
+template<class T, typename std::enable_if<rapidjson_ext_detail::is_list<T>::value>::type * = nullptr>
+void read_json_value(JsonPullReader &reader, T *list, ReaderSizeHint *hint)
+{
+    size_t start_size = list->size();
+    rapidjson_ext_detail::reserve_more(*list, hint->get());
+    read_json_value(reader, list);
+    hint->update(list->size() - start_size);
+}
+
+/**One entry in a ReaderStaticFields table, created with json_field.*/
+template<class T, class M>
+struct ReaderStaticField
+{
+    const char *name;
+    size_t len;
+    M T::*member;
+};
+
+template<size_t N, class T, class M>
+ReaderStaticField<T, M> json_field(const char (&name)[N], M T::*member)
+{
+    return { name, N - 1, member };
+}
+
+/**The fields of an object for read_json_value, the static counterpart of ReaderFields.
+ *
+ * Keys are looked up with a ReaderKeyTable, and each member read with its own read_json_value
+ * overload, so the whole object is read without virtual calls. Each list member has its own
+ * ReaderSizeHint. Generally a single static instance is declared for each type in its
+ * read_json_value overload:
+ *
+ *     inline void read_json_value(JsonPullReader &reader, MyObject *p)
+ *     {
+ *         static const auto fields = make_json_static_fields(
+ *             json_field("x", &MyObject::x),
+ *             json_field("str", &MyObject::str));
+ *         fields.read(reader, p);
+ *     }
+ */
+template<class T, class... M>
+class ReaderStaticFields
+{
+public:
+    /**@param ignore_unknown Skip keys not in the table rather than throwing a ReaderError.*/
+    explicit ReaderStaticFields(bool ignore_unknown, ReaderStaticField<T, M>... fields)
+        : fields(fields...), hints(), ignore_unknown(ignore_unknown)
+    {
+        table.build({ std::make_pair(fields.name, fields.len)... });
+    }
+
+    void read(JsonPullReader &reader, T *out)const
+    {
+        reader.expect(JsonPullReader::Token::start_object);
+        while (reader.next() == JsonPullReader::Token::key)
+        {
+            auto key = reader.string();
+            size_t index = table.find(key.data(), key.size());
+            if (index == ReaderKeyTable::npos)
+            {
+                if (!ignore_unknown) throw ReaderError("Unknown key " + std::string(key));
+                reader.skip_value();
+                continue;
+            }
+            reader.next();
+            read_field(reader, out, index, std::index_sequence_for<M...>());
+        }
+    }
+private:
+    template<size_t... I>
+    void read_field(JsonPullReader &reader, T *out, size_t index, std::index_sequence<I...>)const
+    {
+        ((index == I ? read_member<I>(reader, out) : void()), ...);
+    }
+    template<size_t I>
+    void read_member(JsonPullReader &reader, T *out)const
+    {
+        auto p = &(out->*std::get<I>(fields).member);
+        typedef typename std::remove_pointer<decltype(p)>::type Member;
+        if constexpr (rapidjson_ext_detail::uses_size_hint<Member>::value) read_json_value(reader, p, &hints[I]);
+        else read_json_value(reader, p);
+    }
+
+    std::tuple<ReaderStaticField<T, M>...> fields;
+    /**Lengths of the list members' arrays.*/
+    mutable std::array<ReaderSizeHint, sizeof...(M)> hints;
+    bool ignore_unknown;
+    ReaderKeyTable table;
+};
+
+template<class T, class... M>
+ReaderStaticFields<T, M...> make_json_static_fields(ReaderStaticField<T, M>... fields)
+{
+    return ReaderStaticFields<T, M...>(false, fields...);
+}
+/**ReaderStaticFields that skips keys not in the table.*/
+template<class T, class... M>
+ReaderStaticFields<T, M...> make_json_static_fields_ignore_unknown(ReaderStaticField<T, M>... fields)
+{
+    return ReaderStaticFields<T, M...>(true, fields...);
+}
+
+/**Parse a JSON document into p using its read_json_value overload.
+ * The static counterpart of read_json, for types with read_json_value overloads rather than
+ * make_json_reader.
+ */
+template<class T>
+void read_json_static(const char *str, size_t len, T *p)
+{
+    JsonPullReader reader(str, len);
+    reader.next();
+    read_json_value(reader, p);
+    reader.finish();
+}
+template<class T>
+void read_json_static(const std::string &str, T *p)
+{
+    read_json_static(str.data(), str.size(), p);
+}
+template<class T>
+void read_json_static(std::istream &is, T *p, size_t buffer_size = READ_JSON_BUFFER_SIZE)
+{
+    JsonPullReader reader(is, buffer_size);
+    reader.next();
+    read_json_value(reader, p);
+    reader.finish();
+}
@@ -1,6 +1,89 @@
 #pragma once
 #include "Detail.hpp"
+#include "JsonSink.hpp"
+#include "RawJson.hpp"
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
+
+class JsonWriter;
+template<class T, size_t N> void write_json(JsonWriter &writer, const T(&arr)[N]);
+
+/**Default buffer size for a JsonWriter writing to a JsonSink.*/
+const size_t JSON_WRITER_BUFFER_SIZE = 64 * 1024;
+
+/**Output encoding of a JsonWriter.*/
+enum class JsonEncoding
+{
+    /**JSON text.*/
+    json,
+    /**CBOR (RFC 8949), a binary encoding of the same values, read with read_cbor.
+     * Documents written with next_document form a CBOR sequence, without separators.
+     */
+    cbor
+};
+
+/**An object key quoted and escaped at compile time, so JsonWriter::key and prop just copy it.
+ * Escaping is the same as for other strings. Generally declared constexpr, once per key:
+ *
+ *     static constexpr JsonKey KEY_ID("id");
+ *     writer.prop(KEY_ID, x.id);
+ */
+template<size_t N>
+class JsonKey
+{
+public:
+    constexpr explicit JsonKey(const char (&name)[N])
+        : text(), len(0), raw()
+    {
+        for (size_t i = 0; i < N; ++i) raw[i] = name[i];
+        const char hex_digits[] = "0123456789ABCDEF";
+        text[len++] = '"';
+        for (size_t i = 0; i < N - 1; ++i)
+        {
+            unsigned char c = (unsigned char)name[i];
+            char e = 0;
+            switch (c)
+            {
+            case '\b': e = 'b'; break;
+            case '\f': e = 'f'; break;
+            case '\n': e = 'n'; break;
+            case '\r': e = 'r'; break;
+            case '\t': e = 't'; break;
+            case '"': e = '"'; break;
+            case '\\': e = '\\'; break;
+            default: if (c < 0x20) e = 'u'; break;
+            }
+            if (!e) text[len++] = (char)c;
+            else
+            {
+                text[len++] = '\\';
+                text[len++] = e;
+                if (e == 'u')
+                {
+                    text[len++] = '0';
+                    text[len++] = '0';
+                    text[len++] = hex_digits[c >> 4];
+                    text[len++] = hex_digits[c & 0xF];
+                }
+            }
+        }
+        text[len++] = '"';
+    }
+
+    /**The quoted key.*/
+    constexpr const char *data()const { return text; }
+    constexpr size_t size()const { return len; }
+    /**The key as given, for binary encodings.*/
+    constexpr const char *name()const { return raw; }
+    constexpr size_t name_size()const { return N - 1; }
+private:
+    /**Room for every character escaped as \u00XX.*/
+    char text[(N - 1) * 6 + 2];
+    size_t len;
+    char raw[N];
+};
 
 /**JSON string writer.
  * This implementation uses RapidJSON internally.
@@ -14,16 +97,49 @@
 class JsonWriter
 {
 public:
+    /**Write to an in-memory buffer, accessed with data and size.*/
     JsonWriter();
+    /**Write to a sink through a fixed size buffer.
+     * The buffer is passed to the sink each time it fills, and when the top level value is
+     * complete, so memory use does not depend on the size of the output.
+     */
+    explicit JsonWriter(JsonSink &sink, size_t buffer_size = JSON_WRITER_BUFFER_SIZE);
+    /**Write to caller supplied storage of capacity bytes, which must outlive the writer.
+     * Heap storage is only allocated if the output outgrows it.
+     */
+    JsonWriter(char *buffer, size_t capacity);
+    /**Write to a sink, using caller supplied storage as the buffer.*/
+    JsonWriter(JsonSink &sink, char *buffer, size_t capacity);
     ~JsonWriter();
 
     JsonWriter(const JsonWriter &) = delete;
     JsonWriter& operator = (const JsonWriter &) = delete;
 
-    /**Get the written data buffer.*/
+    /**Get the written data buffer.
+     * When writing to a sink, this is only the data not yet passed to the sink.
+     */
     const char *data()const;
     /**Get the length of the data buffer in bytes.*/
     size_t size()const;
+    /**Pass any buffered data to the sink. Does nothing without a sink.*/
+    void flush();
+    /**Discard the output and start a new document, keeping the buffer capacity and encoding.*/
+    void reset();
+    /**Write separator and start another top level value after the current one, keeping the
+     * output so far. Used to write several documents, such as newline delimited JSON.
+     * With a sink, the separator is buffered until the next flush.
+     */
+    void next_document(char separator = '\n');
+    /**Set the encoding of the output, JSON text by default.
+     * Change it only before writing a document, such as after reset. Every write_json overload
+     * works with either encoding.
+     */
+    void set_encoding(JsonEncoding encoding);
+    JsonEncoding encoding()const;
+    /**Ensure the buffer can hold n bytes without growing.*/
+    void reserve(size_t n);
+    /**Buffer capacity in bytes.*/
+    size_t capacity()const;
 
     // Basic outputs
     void start_array();
@@ -33,6 +149,11 @@ public:
 
     void key(const char *str, size_t len);
     template<size_t N> void key(const char (&str)[N]) { key(str, N - 1); }
+    template<size_t N> void key(const JsonKey<N> &k) { key_quoted(k.data(), k.size(), k.name(), k.name_size()); }
+    /**Write a key already quoted and escaped, such as from JsonKey.
+     * str is the key itself, written instead for binary encodings.
+     */
+    void key_quoted(const char *quoted, size_t quoted_len, const char *str, size_t len);
 
     void value_null();
     void value_string(const char *str, size_t len);
@@ -43,7 +164,34 @@ public:
     void value_int64(long long x);
     void value_uint64(unsigned long long x);
     void value_double(double x);
+    /**Write the shortest decimal that reads back as the same float.*/
+    void value_float(float x);
+    /**Write x rounded to exactly precision digits after the decimal point, and no decimal point
+     * if precision is 0.
+     */
+    void value_float(float x, int precision);
     void value_bool(bool x);
+    /**Write a value already serialized as JSON, such as a RawJson or a cached fragment.
+     * The text is copied as is after any separator, so json must be a single valid JSON value.
+     * Text that is empty or only whitespace is an error.
+     * With JsonEncoding::cbor the text is parsed and encoded instead, and invalid JSON is an error
+     * that writes nothing.
+     */
+    void value_raw(const char *json, size_t len);
+    void value_raw(const std::string &json) { value_raw(json.data(), json.size()); }
+
+    /**Write an array of numbers. The output is the same as value for each element between
+     * start_array and end_array, but space is reserved and the elements are formatted in bulk.
+     * Throws before writing anything if a double or float is not finite.
+     */
+    void value_array(const int *p, size_t n);
+    void value_array(const unsigned *p, size_t n);
+    void value_array(const long *p, size_t n);
+    void value_array(const unsigned long *p, size_t n);
+    void value_array(const long long *p, size_t n);
+    void value_array(const unsigned long long *p, size_t n);
+    void value_array(const float *p, size_t n);
+    void value_array(const double *p, size_t n);
 
     /** Generic write value helper. Calls global write_json.*/
     template<class T> void value(const T &val)
@@ -62,11 +210,76 @@ public:
         key(str, N - 1);
         value(val);
     }
+    /**Object property helper for a key escaped at compile time.*/
+    template<size_t N, class T>
+    void prop(const JsonKey<N> &k, const T &val)
+    {
+        key(k);
+        value(val);
+    }
 private:
     struct Impl;
+    /**Impl is constructed in place, so a JsonWriter makes no allocation of its own.*/
+    static const size_t IMPL_SIZE = 64 * sizeof(void*);
+    alignas(std::max_align_t) char impl_storage[IMPL_SIZE];
     Impl *impl;
 };
 
+/**Pool of in-memory JsonWriter objects.
+ * Writers are reset and reused with their buffers intact, so once warmed up, serializing through
+ * a pooled writer does not allocate.
+ *
+ *     auto writer = JsonWriterPool::thread_pool().acquire();
+ *     writer->value(x);
+ *     send(writer->data(), writer->size());
+ */
+class JsonWriterPool
+{
+public:
+    /**Writer borrowed from a pool, returned when destroyed.
+     * Pools are not thread safe, so a handle can not be moved, and is always returned by the
+     * thread that acquired it.
+     */
+    class Handle
+    {
+    public:
+        Handle(const Handle &) = delete;
+        Handle& operator = (const Handle &) = delete;
+        ~Handle();
+
+        JsonWriter &operator *() { return *writer; }
+        JsonWriter *operator ->() { return writer.get(); }
+    private:
+        friend class JsonWriterPool;
+        Handle(JsonWriterPool *pool, std::unique_ptr<JsonWriter> &&writer)
+            : pool(pool), writer(std::move(writer))
+        {}
+
+        JsonWriterPool *pool;
+        std::unique_ptr<JsonWriter> writer;
+    };
+
+    /**@param max_writers Maximum number of idle writers kept.
+     * @param max_capacity Writers whose buffer grew beyond this are freed rather than kept.
+     */
+    explicit JsonWriterPool(size_t max_writers = 8, size_t max_capacity = 1024 * 1024);
+
+    JsonWriterPool(const JsonWriterPool &) = delete;
+    JsonWriterPool& operator = (const JsonWriterPool &) = delete;
+
+    /**Get an empty writer, writing JSON text whatever encoding it was last used with.*/
+    Handle acquire();
+
+    /**Pool for the calling thread.*/
+    static JsonWriterPool &thread_pool();
+private:
+    void release(std::unique_ptr<JsonWriter> &&writer);
+
+    size_t max_writers;
+    size_t max_capacity;
+    std::vector<std::unique_ptr<JsonWriter>> writers;
+};
+
 // Basic type overloads
 inline void write_json(JsonWriter &writer, const char *str)
 {
@@ -82,9 +295,15 @@ inline void write_json(JsonWriter &writer, int x) { writer.value_int(x); }
 inline void write_json(JsonWriter &writer, unsigned x) { writer.value_uint(x); }
 inline void write_json(JsonWriter &writer, long long x) { writer.value_int64(x); }
 inline void write_json(JsonWriter &writer, unsigned long long x) { writer.value_uint64(x); }
-inline void write_json(JsonWriter &writer, float x) { writer.value_double(x); }
+inline void write_json(JsonWriter &writer, float x) { writer.value_float(x); }
 inline void write_json(JsonWriter &writer, double x) { writer.value_double(x); }
 inline void write_json(JsonWriter &writer, bool x) { writer.value_bool(x); }
+/**An empty RawJson, such as one whose key was missing from the input, is written as null.*/
+inline void write_json(JsonWriter &writer, const RawJson &x)
+{
+    if (x.json.empty()) writer.value_null();
+    else writer.value_raw(x.json);
+}
 
 inline void write_json(JsonWriter &writer, long x)
 {
@@ -133,14 +352,22 @@ void write_json(JsonWriter &writer, const T &iterable)
 /**Generic template for arrays. Writes a JSON array, using write_json for each element.
  * 
  * iterable may be any value that can be used with the C++11 range-based for loop.
+ * Contiguous arrays of numbers, such as std::vector<int>, are written with JsonWriter::value_array.
  */
 template<class T> void write_json_array(JsonWriter &writer,  const T &iterable)
 {
-    writer.start_array();
-    for (auto &i : iterable)
+    if constexpr (rapidjson_ext_detail::is_number_array<T>::value)
+    {
+        writer.value_array(std::data(iterable), std::size(iterable));
+    }
+    else
     {
-        write_json(writer, i);
+        writer.start_array();
+        for (auto &i : iterable)
+        {
+            write_json(writer, i);
+        }
+        writer.end_array();
     }
-    writer.end_array();
 }
 
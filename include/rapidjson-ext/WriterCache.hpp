@@ -0,0 +1,87 @@
+#pragma once
+#include "Writer.hpp"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+
+/**Serialized JSON of values that rarely change, such as configuration blocks, so that writing
+ * them again only copies the bytes with JsonWriter::value_raw.
+ *
+ * Values are keyed by their address and type, as an object and its first member share an address,
+ * and a version number, which the owner of a value must change whenever the value changes. A new
+ * version replaces the entry for the old one. Once max_entries values are cached, the cache is
+ * cleared and starts filling again.
+ *
+ *     static JsonFragmentCache cache;
+ *     writer.key("config");
+ *     cache.write(writer, config, config_version);
+ *
+ * The cache may be shared between threads. Fragments are JSON, so a writer with
+ * JsonEncoding::cbor is passed the value by write_json as usual.
+ */
+class JsonFragmentCache
+{
+public:
+    explicit JsonFragmentCache(size_t max_entries = 1024);
+
+    JsonFragmentCache(const JsonFragmentCache &) = delete;
+    JsonFragmentCache& operator = (const JsonFragmentCache &) = delete;
+
+    /**Write val, serializing it with write_json only if it is not cached at this version.*/
+    template<class T>
+    void write(JsonWriter &writer, const T &val, uint64_t version)
+    {
+        if (writer.encoding() != JsonEncoding::json)
+        {
+            write_json(writer, val);
+            return;
+        }
+        auto json = find(&val, typeid(T), version);
+        if (!json)
+        {
+            auto tmp = JsonWriterPool::thread_pool().acquire();
+            write_json(*tmp, val);
+            json = insert(&val, typeid(T), version, std::string(tmp->data(), tmp->size()));
+        }
+        writer.value_raw(*json);
+    }
+
+    /**Cached JSON of the value of type at id, or null if it is not cached at this version.*/
+    std::shared_ptr<const std::string> find(const void *id, std::type_index type, uint64_t version)const;
+    /**Cache json as the value of type at id, returning the cached copy.*/
+    std::shared_ptr<const std::string> insert(const void *id, std::type_index type, uint64_t version, std::string &&json);
+    /**Remove the entry for val, such as before it is destroyed.*/
+    template<class T>
+    void erase(const T &val) { erase(&val, typeid(T)); }
+    void erase(const void *id, std::type_index type);
+    void clear();
+    size_t size()const;
+private:
+    struct Key
+    {
+        const void *id;
+        std::type_index type;
+
+        bool operator == (const Key &other)const { return id == other.id && type == other.type; }
+    };
+    struct KeyHash
+    {
+        size_t operator ()(const Key &key)const
+        {
+            return std::hash<const void*>()(key.id) ^ (key.type.hash_code() * 31);
+        }
+    };
+    struct Entry
+    {
+        uint64_t version;
+        std::shared_ptr<const std::string> json;
+    };
+
+    size_t max_entries;
+    mutable std::mutex mutex;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include "Writer.hpp"
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+/**Layout of the documents written by write_json_lines.*/
+enum class JsonLinesFormat
+{
+    /**Newline delimited JSON, each value followed by a newline.*/
+    lines,
+    /**A single JSON array.*/
+    array
+};
+
+/**Serialize count values to sink in parallel.
+ *
+ * The values are split into batches, which worker threads take in turn and serialize into
+ * their own reusable JsonWriter. Each batch is passed to the sink in order once the batches
+ * before it are written, so the output is the same as writing the values one by one.
+ *
+ * @param write_value Writes value i as a single JSON value. Called concurrently from up to
+ *   threads worker threads, or one per core if 0.
+ */
+void write_json_lines(
+    size_t count, const std::function<void(JsonWriter &writer, size_t i)> &write_value,
+    JsonSink &sink, JsonLinesFormat format = JsonLinesFormat::lines, unsigned threads = 0);
+
+/**Serialize each element of a random access range to sink in parallel, using write_json.*/
+template<class Range>
+void write_json_lines(
+    const Range &range, JsonSink &sink, JsonLinesFormat format = JsonLinesFormat::lines, unsigned threads = 0)
+{
+    auto begin = std::begin(range);
+    typedef typename std::iterator_traits<decltype(begin)>::iterator_category category;
+    static_assert(std::is_base_of<std::random_access_iterator_tag, category>::value,
+        "write_json_lines requires a random access range");
+    write_json_lines(
+        (size_t)std::distance(begin, std::end(range)),
+        [begin](JsonWriter &writer, size_t i) { write_json(writer, begin[i]); },
+        sink, format, threads);
+}
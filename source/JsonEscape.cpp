@@ -0,0 +1,136 @@
+#include "JsonEscape.hpp"
+#include "WriterBuffer.hpp"
+#include "Simd.hpp"
+
+namespace
+{
+    /**Escape character for each byte, 'u' for \u00XX, or 0 if none needed.
+     * Constant initialized, so it can be used by JsonWriters in other static initializers.
+     */
+    struct EscapeTable
+    {
+        char escape[256];
+
+        constexpr EscapeTable() : escape()
+        {
+            for (int c = 0; c < 0x20; ++c) escape[c] = 'u';
+            escape[(unsigned char)'\b'] = 'b';
+            escape[(unsigned char)'\f'] = 'f';
+            escape[(unsigned char)'\n'] = 'n';
+            escape[(unsigned char)'\r'] = 'r';
+            escape[(unsigned char)'\t'] = 't';
+            escape[(unsigned char)'"'] = '"';
+            escape[(unsigned char)'\\'] = '\\';
+        }
+    };
+    constexpr EscapeTable escape_table;
+
+    size_t unescaped_prefix_scalar(const char *str, size_t len, size_t i)
+    {
+        while (i < len && !escape_table.escape[(unsigned char)str[i]]) ++i;
+        return i;
+    }
+
+#ifdef RAPIDJSON_EXT_SSE2
+    size_t unescaped_prefix_sse2(const char *str, size_t len)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1F);
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+            // Unsigned v <= 0x1F
+            __m128i is_control = _mm_cmpeq_epi8(_mm_max_epu8(v, control), control);
+            __m128i m = _mm_or_si128(is_control,
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+            if (mask) return i + count_trailing_zeros(mask);
+        }
+        return unescaped_prefix_scalar(str, len, i);
+    }
+#endif
+
+#ifdef RAPIDJSON_EXT_AVX2
+    __attribute__((target("avx2")))
+    size_t unescaped_prefix_avx2(const char *str, size_t len)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i control = _mm256_set1_epi8(0x1F);
+        size_t i = 0;
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+            __m256i is_control = _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control);
+            __m256i m = _mm256_or_si256(is_control,
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+            if (mask) return i + count_trailing_zeros(mask);
+        }
+        return i + unescaped_prefix_sse2(str + i, len - i);
+    }
+#endif
+
+#if defined(RAPIDJSON_EXT_AVX2)
+    typedef size_t (*UnescapedPrefixFn)(const char *str, size_t len);
+
+    UnescapedPrefixFn select_unescaped_prefix()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return unescaped_prefix_avx2;
+        return unescaped_prefix_sse2;
+    }
+#endif
+
+    size_t unescaped_prefix(const char *str, size_t len)
+    {
+#if defined(RAPIDJSON_EXT_AVX2)
+        // Selected on first call rather than by a global initializer, which may not have run yet
+        // when called from another static initializer
+        static const UnescapedPrefixFn fn = select_unescaped_prefix();
+        return fn(str, len);
+#elif defined(RAPIDJSON_EXT_SSE2)
+        return unescaped_prefix_sse2(str, len);
+#else
+        return unescaped_prefix_scalar(str, len, 0);
+#endif
+    }
+
+    void write_escape(WriterBuffer &out, unsigned char c)
+    {
+        static const char hex_digits[] = "0123456789ABCDEF";
+        char e = escape_table.escape[c];
+        if (e == 'u')
+        {
+            char buf[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xF] };
+            out.write(buf, 6);
+        }
+        else
+        {
+            char buf[2] = { '\\', e };
+            out.write(buf, 2);
+        }
+    }
+}
+
+size_t json_unescaped_prefix(const char *str, size_t len)
+{
+    return unescaped_prefix(str, len);
+}
+
+void write_json_string(WriterBuffer &out, const char *str, size_t len)
+{
+    out.Put('"');
+    for (;;)
+    {
+        size_t run = unescaped_prefix(str, len);
+        out.write(str, run);
+        if (run == len) break;
+        write_escape(out, (unsigned char)str[run]);
+        str += run + 1;
+        len -= run + 1;
+    }
+    out.Put('"');
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+class WriterBuffer;
+
+/**Length of the longest prefix of str that needs no escaping in a JSON string.
+ *
+ * Scans 32 bytes at a time with AVX2 where the CPU supports it, otherwise 16 bytes at a time with
+ * SSE2 on x86-64, falling back to a scalar loop on other targets.
+ */
+size_t json_unescaped_prefix(const char *str, size_t len);
+
+/**Write str to out as a quoted JSON string.
+ * Escapes the same characters in the same way as rapidjson::Writer, copying the runs in between
+ * as a whole.
+ */
+void write_json_string(WriterBuffer &out, const char *str, size_t len);
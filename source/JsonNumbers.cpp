@@ -0,0 +1,183 @@
+#include "JsonNumbers.hpp"
+#include "WriterBuffer.hpp"
+#include <rapidjson/internal/dtoa.h>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace
+{
+    const char DIGIT_PAIRS[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    /**Number of decimal digits in x, counted with comparisons rather than branches.*/
+    unsigned count_digits(uint32_t x)
+    {
+        static const uint32_t POW10[] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+        };
+        unsigned digits = 1;
+        for (unsigned i = 1; i < 10; ++i) digits += x >= POW10[i];
+        return digits;
+    }
+    unsigned count_digits(uint64_t x)
+    {
+        static const uint64_t POW10[] = {
+            1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+            100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+            10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+            100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+        };
+        unsigned digits = 1;
+        for (unsigned i = 1; i < 20; ++i) digits += x >= POW10[i];
+        return digits;
+    }
+
+    /**Write the digits of x at out, returning the end of them.*/
+    template<class U>
+    char *format_unsigned(U x, char *out)
+    {
+        char *end = out + count_digits(x);
+        char *p = end;
+        while (x >= 100)
+        {
+            unsigned pair = (unsigned)(x % 100);
+            x /= 100;
+            p -= 2;
+            p[0] = DIGIT_PAIRS[pair * 2];
+            p[1] = DIGIT_PAIRS[pair * 2 + 1];
+        }
+        if (x >= 10)
+        {
+            p[-2] = DIGIT_PAIRS[x * 2];
+            p[-1] = DIGIT_PAIRS[x * 2 + 1];
+        }
+        else p[-1] = (char)('0' + x);
+        return end;
+    }
+
+    template<class T>
+    char *format_integer(T x, char *out)
+    {
+        typedef typename std::conditional<sizeof(T) <= 4, uint32_t, uint64_t>::type U;
+        if constexpr (std::is_signed<T>::value)
+        {
+            *out = '-';
+            out += x < 0;
+            // Negate as unsigned, so the most negative value does not overflow
+            U u = x < 0 ? (U)0 - (U)x : (U)x;
+            return format_unsigned(u, out);
+        }
+        else return format_unsigned((U)x, out);
+    }
+
+    /**Format the elements in batches of at most max_len bytes each, including the ','.
+     * Batches only use the space left in the buffer, so it is not flushed or grown any sooner
+     * than writing the elements one at a time. Without room for even one element at its longest,
+     * an element is formatted on the stack and copied, which only grows the buffer if it must.
+     */
+    template<size_t max_len, class T, class F>
+    void write_batched(WriterBuffer &out, const T *p, size_t n, F &&format)
+    {
+        size_t i = 0;
+        while (i < n)
+        {
+            size_t batch = std::min<size_t>({ 256, n - i, out.available() / max_len });
+            if (batch == 0)
+            {
+                char scratch[max_len];
+                char *q = scratch;
+                *q = ',';
+                q += i != 0;
+                q = format(p[i], q);
+                out.write(scratch, (size_t)(q - scratch));
+                ++i;
+                continue;
+            }
+            size_t end = i + batch;
+            char *q = out.prepare(batch * max_len);
+            for (; i < end; ++i)
+            {
+                // The ',' is always stored, but only kept after the first element
+                *q = ',';
+                q += i != 0;
+                q = format(p[i], q);
+            }
+            out.commit(q);
+        }
+    }
+
+    template<class T>
+    void write_integers(WriterBuffer &out, const T *p, size_t n)
+    {
+        // Digits, sign and ','
+        const size_t max_len = std::numeric_limits<T>::digits10 + 3;
+        write_batched<max_len>(out, p, n, [](T x, char *q) { return format_integer(x, q); });
+    }
+}
+
+void write_json_numbers(WriterBuffer &out, const int *p, size_t n)
+{
+    write_integers(out, p, n);
+}
+
+void write_json_numbers(WriterBuffer &out, const unsigned *p, size_t n)
+{
+    write_integers(out, p, n);
+}
+
+void write_json_numbers(WriterBuffer &out, const long *p, size_t n)
+{
+    write_integers(out, p, n);
+}
+
+void write_json_numbers(WriterBuffer &out, const unsigned long *p, size_t n)
+{
+    write_integers(out, p, n);
+}
+
+void write_json_numbers(WriterBuffer &out, const long long *p, size_t n)
+{
+    write_integers(out, p, n);
+}
+
+void write_json_numbers(WriterBuffer &out, const unsigned long long *p, size_t n)
+{
+    write_integers(out, p, n);
+}
+
+void write_json_numbers(WriterBuffer &out, const double *p, size_t n, int max_decimal_places)
+{
+    // rapidjson::Writer formats each double into a 25 byte buffer
+    write_batched<26>(out, p, n, [max_decimal_places](double x, char *q)
+    {
+        return rapidjson::internal::dtoa(x, q, max_decimal_places);
+    });
+}
+
+void write_json_numbers(WriterBuffer &out, const float *p, size_t n)
+{
+    // As JsonWriter::value_float, with room for a ".0"
+    const size_t max_len = 32;
+    write_batched<max_len>(out, p, n, [](float x, char *q)
+    {
+        char *end = std::to_chars(q, q + max_len - 3, x).ptr;
+        if (std::find_if(q, end, [](char c) { return c == '.' || c == 'e'; }) == end)
+        {
+            *end++ = '.';
+            *end++ = '0';
+        }
+        return end;
+    });
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+
+class WriterBuffer;
+
+/**Write the elements of a numeric array to out, separated by ',', without the brackets.
+ *
+ * The output is the same as rapidjson::Writer writing each element, but space for a batch of
+ * elements is reserved at once and each is formatted straight into the buffer. Integers are
+ * formatted two digits at a time from a table, with the digit count found without branches.
+ */
+void write_json_numbers(WriterBuffer &out, const int *p, size_t n);
+void write_json_numbers(WriterBuffer &out, const unsigned *p, size_t n);
+void write_json_numbers(WriterBuffer &out, const long *p, size_t n);
+void write_json_numbers(WriterBuffer &out, const unsigned long *p, size_t n);
+void write_json_numbers(WriterBuffer &out, const long long *p, size_t n);
+void write_json_numbers(WriterBuffer &out, const unsigned long long *p, size_t n);
+/**Values must all be finite. max_decimal_places is as for rapidjson::Writer.*/
+void write_json_numbers(WriterBuffer &out, const double *p, size_t n, int max_decimal_places);
+/**Values must all be finite. Each is the shortest decimal that reads back as the same float.*/
+void write_json_numbers(WriterBuffer &out, const float *p, size_t n);
@@ -0,0 +1,47 @@
+#include "JsonSink.hpp"
+#include <cerrno>
+#include <climits>
+#include <ostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#   include <io.h>
+#else
+#   include <unistd.h>
+#endif
+
+void JsonFdSink::write(const char *data, size_t len)
+{
+    while (len)
+    {
+#ifdef _WIN32
+        int ret = ::_write(fd, data, (unsigned)(len > INT_MAX ? INT_MAX : len));
+#else
+        ssize_t ret = ::write(fd, data, len);
+        if (ret < 0 && errno == EINTR) continue;
+#endif
+        if (ret < 0) throw std::runtime_error("File write error");
+        data += ret;
+        len -= (size_t)ret;
+    }
+}
+
+void JsonFileSink::write(const char *data, size_t len)
+{
+    if (fwrite(data, 1, len, file) != len) throw std::runtime_error("File write error");
+}
+
+void JsonFileSink::flush()
+{
+    if (fflush(file) != 0) throw std::runtime_error("File write error");
+}
+
+void JsonOStreamSink::write(const char *data, size_t len)
+{
+    if (!os.write(data, (std::streamsize)len)) throw std::runtime_error("Stream write error");
+}
+
+void JsonOStreamSink::flush()
+{
+    if (!os.flush()) throw std::runtime_error("Stream write error");
+}
@@ -0,0 +1,31 @@
+#include "JsonStats.hpp"
+
+namespace
+{
+    thread_local JsonStats *current_stats = nullptr;
+}
+
+bool json_stats_enabled()
+{
+#ifdef RAPIDJSON_EXT_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+JsonStatsScope::JsonStatsScope(JsonStats &stats)
+    : prev(current_stats)
+{
+    current_stats = &stats;
+}
+
+JsonStatsScope::~JsonStatsScope()
+{
+    current_stats = prev;
+}
+
+JsonStats *JsonStatsScope::current()
+{
+    return current_stats;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "JsonStats.hpp"
+
+/**Code that only exists when collecting JsonStats.
+ *
+ *     RAPIDJSON_EXT_STATS_ONLY(if (auto stats = JsonStatsScope::current()) ++stats->frames;)
+ */
+#ifdef RAPIDJSON_EXT_STATS
+#   define RAPIDJSON_EXT_STATS_ONLY(...) __VA_ARGS__
+#else
+#   define RAPIDJSON_EXT_STATS_ONLY(...)
+#endif
+
+#ifdef RAPIDJSON_EXT_STATS
+#include <chrono>
+
+/**Adds the time until the end of the scope to a JsonStats counter. Does nothing if stats is null.*/
+class JsonStatsTimer
+{
+public:
+    JsonStatsTimer(JsonStats *stats, uint64_t JsonStats::*counter)
+        : stats(stats), counter(counter), start()
+    {
+        if (stats) start = Clock::now();
+    }
+    ~JsonStatsTimer()
+    {
+        if (stats)
+        {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+            stats->*counter += (uint64_t)ns.count();
+        }
+    }
+
+    JsonStatsTimer(const JsonStatsTimer &) = delete;
+    JsonStatsTimer& operator = (const JsonStatsTimer &) = delete;
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    JsonStats *stats;
+    uint64_t JsonStats::*counter;
+    Clock::time_point start;
+};
+#endif
@@ -1,113 +1,493 @@
 #include "Reader.hpp"
+#include "ReaderLines.hpp"
+#include "ReaderArena.hpp"
+#include "ReaderHandler.hpp"
+#include "JsonStatsHooks.hpp"
+#include "ReaderStream.hpp"
 #include <rapidjson/reader.h>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-using rapidjson::SizeType;
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <Windows.h>
+#   include <io.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
 
-class Reader
+namespace
 {
-public:
-    std::stack<std::unique_ptr<ReaderFrame>> stack;
+    /**Stream for Reader::stream, if it supports skipping.*/
+    ReaderStream *skip_stream(ReaderStream &ss) { return &ss; }
+    template<class Stream> ReaderStream *skip_stream(Stream &ss) { return nullptr; }
 
-    ~Reader() {}
+    template<unsigned flags, class Stream>
+    void parse(Stream &ss, std::unique_ptr<ReaderFrame> &&root)
+    {
+        ReaderArena::Scope arena(ReaderArena::thread_arena());
+        Reader reader;
+        reader.stream = skip_stream(ss);
+        reader.stack.emplace(std::move(root));
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(reader.stats, &JsonStats::parse_ns);)
 
-    bool RawNumber(const char* str, SizeType length, bool copy)
+        rapidjson::Reader json_reader;
+        if (!json_reader.Parse<flags>(ss, reader)) throw std::runtime_error("Parse error");
+        RAPIDJSON_EXT_STATS_ONLY(if (reader.stats)
+        {
+            ++reader.stats->documents_read;
+            reader.stats->bytes_read += ss.Tell();
+        })
+    }
+    void parse(ReaderStream &ss, std::unique_ptr<ReaderFrame> &&root)
     {
-        std::terminate();
+        parse<rapidjson::kParseDefaultFlags>(ss, std::move(root));
     }
 
-    bool Null()
+    /**Read-only memory mapping of an entire file.*/
+    class MappedFile
     {
-        stack.top()->value_null();
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
-    }
-    bool Bool(bool b)
+    public:
+        explicit MappedFile(const std::string &path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile& operator = (const MappedFile &) = delete;
+
+        const char *data()const { return map; }
+        size_t size()const { return len; }
+    private:
+        const char *map;
+        size_t len;
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#endif
+    };
+
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string &path)
+        : map(nullptr), len(0), file(INVALID_HANDLE_VALUE), mapping(nullptr)
     {
-        stack.top()->value_bool(b);
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open " + path);
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to get size of " + path);
+        }
+        len = (size_t)file_size.QuadPart;
+        if (len == 0) return; // Can not map an empty file
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) map = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!map)
+        {
+            if (mapping) CloseHandle(mapping);
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map " + path);
+        }
     }
-    bool Int(int i)
+    MappedFile::~MappedFile()
     {
-        stack.top()->value_int(i);
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        if (map) UnmapViewOfFile(map);
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
     }
-    bool Uint(unsigned i)
+#else
+    MappedFile::MappedFile(const std::string &path)
+        : map(nullptr), len(0)
     {
-        stack.top()->value_uint(i);
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Failed to open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to get size of " + path);
+        }
+        len = (size_t)st.st_size;
+        if (len == 0)
+        {
+            // Can not map an empty file
+            close(fd);
+            return;
+        }
+        void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error("Failed to map " + path);
+        madvise(p, len, MADV_SEQUENTIAL);
+        map = (const char*)p;
     }
-    bool Int64(int64_t i)
+    MappedFile::~MappedFile()
     {
-        stack.top()->value_int64(i);
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        if (map) munmap((void*)map, len);
     }
-    bool Uint64(uint64_t i)
+#endif
+
+    /**Smallest chunk given to a read_json_lines or read_json_array_parallel worker.*/
+    const size_t LINES_MIN_CHUNK = 64 * 1024;
+
+    bool is_line_space(char c)
     {
-        stack.top()->value_uint64(i);
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        return c == ' ' || c == '\t' || c == '\r';
     }
-    bool Double(double d)
+
+    /**Parse each document in a chunk of whole lines, reusing one Reader for all of them.
+     * Each parse only sees its own line, so a document never continues onto the next one, however
+     * the input is split into chunks.
+     */
+    void parse_lines(const char *str, size_t len, ReaderLinesHandler &handler, size_t chunk)
     {
-        stack.top()->value_double(d);
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        ReaderArena::Scope arena(ReaderArena::thread_arena());
+        Reader reader;
+        rapidjson::Reader json_reader;
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(reader.stats, &JsonStats::parse_ns);)
+        size_t pos = 0;
+        while (pos < len)
+        {
+            const char *line = str + pos;
+            auto nl = (const char*)std::memchr(line, '\n', len - pos);
+            size_t line_len = nl ? (size_t)(nl - line) : len - pos;
+            pos += line_len + 1;
+            if (std::all_of(line, line + line_len, is_line_space)) continue;
+
+            ReaderStream ss(line, line_len);
+            reader.stream = &ss;
+            reader.stack.emplace(handler.document(chunk));
+            if (!json_reader.Parse<rapidjson::kParseStopWhenDoneFlag>(ss, reader))
+                throw std::runtime_error("Parse error");
+            handler.end_document(chunk);
+            RAPIDJSON_EXT_STATS_ONLY(if (reader.stats)
+            {
+                ++reader.stats->documents_read;
+                reader.stats->bytes_read += ss.Tell();
+            })
+
+            while (ss.Tell() < line_len && is_line_space(ss.Peek())) ss.Take();
+            if (ss.Tell() < line_len) throw ReaderError("Expected end of line");
+        }
     }
-    bool String(const char* str, SizeType length, bool copy)
+
+    /**Run parse_chunk(i) for each of count chunks on up to threads workers, including the
+     * calling thread. Once all workers stop, the error from the earliest failing chunk is rethrown.
+     */
+    template<class F>
+    void parse_chunks_parallel(size_t count, unsigned threads, F &&parse_chunk)
     {
-        stack.top()->value_string({str, (size_t)length});
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        std::vector<std::exception_ptr> errors(count);
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        auto chunk_worker = [&]()
+        {
+            size_t i;
+            while (!failed && (i = next++) < count)
+            {
+                try
+                {
+                    parse_chunk(i);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                    failed = true;
+                }
+            }
+        };
+#ifdef RAPIDJSON_EXT_STATS
+        // Each worker, including this thread, collects its own stats, which are added to the
+        // caller's under a lock as they finish
+        auto caller_stats = JsonStatsScope::current();
+        std::mutex stats_mutex;
+        auto worker = [&]()
+        {
+            JsonStats stats;
+            {
+                JsonStatsScope scope(stats);
+                chunk_worker();
+            }
+            if (caller_stats)
+            {
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                *caller_stats += stats;
+            }
+        };
+#else
+        auto &worker = chunk_worker;
+#endif
+
+        size_t worker_count = std::min((size_t)threads, count);
+        if (worker_count <= 1) worker();
+        else
+        {
+            std::vector<std::thread> workers;
+            workers.reserve(worker_count - 1);
+            try
+            {
+                for (size_t i = 1; i < worker_count; ++i) workers.emplace_back(worker);
+            }
+            catch (...)
+            {
+                failed = true;
+                for (auto &t : workers) t.join();
+                throw;
+            }
+            worker();
+            for (auto &t : workers) t.join();
+        }
+        for (auto &error : errors)
+        {
+            if (error) std::rethrow_exception(error);
+        }
     }
-    bool StartObject()
+
+    /**Split str into chunks of whole lines, and parse them on up to threads workers.*/
+    void parse_lines_parallel(const char *str, size_t len, ReaderLinesHandler &handler, unsigned threads)
     {
-        auto next = stack.top()->start_object();
-        if (next)
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        // A few chunks per thread, so that a slow chunk does not hold up the rest
+        size_t target = std::max(LINES_MIN_CHUNK, len / ((size_t)threads * 4) + 1);
+
+        std::vector<std::pair<size_t, size_t>> chunks;
+        size_t pos = 0;
+        while (pos < len)
         {
-            next->start_object();
-            stack.push(std::move(next));
+            size_t end = len;
+            if (len - pos > target)
+            {
+                auto nl = (const char*)std::memchr(str + pos + target, '\n', len - pos - target);
+                if (nl) end = (size_t)(nl - str) + 1;
+            }
+            chunks.emplace_back(pos, end);
+            pos = end;
         }
-        return true;
+
+        handler.start(chunks.size());
+        parse_chunks_parallel(chunks.size(), threads, [&](size_t i)
+        {
+            parse_lines(str + chunks[i].first, chunks[i].second - chunks[i].first, handler, i);
+        });
     }
-    bool Key(const char* str, SizeType length, bool copy)
+
+    bool is_json_space(char c)
     {
-        stack.emplace(stack.top()->key({str, (size_t)length}));
-        return true;
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
     }
-    bool EndObject(SizeType memberCount)
+
+    /**Parse a chunk of the elements of a top level array, separated by commas.
+     * Only the chunk of an empty array may have no elements.
+     */
+    void parse_array_chunk(const char *str, size_t len, ReaderLinesHandler &handler, size_t chunk, bool allow_empty)
     {
-        stack.top()->end_object();
-        if (!stack.top()->is_array()) stack.pop();
-        return true;
+        ReaderArena::Scope arena(ReaderArena::thread_arena());
+        Reader reader;
+        rapidjson::Reader json_reader;
+        ReaderStream ss(str, len);
+        reader.stream = &ss;
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(reader.stats, &JsonStats::parse_ns);)
+
+        while (ss.Tell() < len && is_json_space(ss.Peek())) ss.Take();
+        if (ss.Tell() == len)
+        {
+            if (!allow_empty) throw std::runtime_error("Parse error");
+            return;
+        }
+        while (true)
+        {
+            // After a ',' Parse fails at the end of the chunk, as another element is required
+            reader.stack.emplace(handler.document(chunk));
+            if (!json_reader.Parse<rapidjson::kParseStopWhenDoneFlag>(ss, reader))
+                throw std::runtime_error("Parse error");
+            handler.end_document(chunk);
+
+            while (ss.Tell() < len && is_json_space(ss.Peek())) ss.Take();
+            if (ss.Tell() == len) break;
+            if (ss.Take() != ',') throw std::runtime_error("Parse error");
+        }
+        RAPIDJSON_EXT_STATS_ONLY(if (reader.stats) reader.stats->bytes_read += len;)
     }
-    bool StartArray()
+
+    /**Split the elements of the top level array in str into chunks of about target bytes.
+     *
+     * A pre-scan tracks strings and bracket depth to find the commas between elements, without
+     * otherwise validating them, which is left to parsing each chunk. Returns the offsets of each
+     * chunk, excluding the '[', ']' and commas around it.
+     */
+    std::vector<std::pair<size_t, size_t>> split_array(const char *str, size_t len, size_t target)
     {
-        auto next = stack.top()->start_array();
-        if (next)
+        const char *end = str + len;
+        const char *p = str;
+        while (p != end && is_json_space(*p)) ++p;
+        if (p == end || *p != '[') throw std::runtime_error("Parse error");
+        const char *chunk_start = ++p;
+
+        std::vector<std::pair<size_t, size_t>> chunks;
+        size_t depth = 0;
+        while (true)
         {
-            next->start_array();
-            stack.push(std::move(next));
+            if (depth == 0 && (size_t)(p - chunk_start) >= target)
+            {
+                // Past the target size, so end the chunk at the next comma at this depth
+                while (p != end && *p != ',' && *p != '"' && (*p | 0x20) != '{' && (*p | 0x20) != '}') ++p;
+                if (p != end && *p == ',')
+                {
+                    chunks.emplace_back((size_t)(chunk_start - str), (size_t)(p - str));
+                    chunk_start = ++p;
+                    continue;
+                }
+            }
+            else p = json_find_structural(p, end);
+            if (p == end) throw std::runtime_error("Parse error");
+
+            char c = *p++;
+            if (c == '"')
+            {
+                while (true)
+                {
+                    p = json_find_string_end(p, end);
+                    if (p == end) throw std::runtime_error("Parse error");
+                    if (*p++ == '"') break;
+                    // Skip the escaped character
+                    if (p == end) throw std::runtime_error("Parse error");
+                    ++p;
+                }
+            }
+            else if (c == '[' || c == '{') ++depth;
+            else if (depth > 0) --depth;
+            else if (c == ']')
+            {
+                chunks.emplace_back((size_t)(chunk_start - str), (size_t)(p - 1 - str));
+                break;
+            }
+            else throw std::runtime_error("Parse error");
         }
-        return true;
+        while (p != end && is_json_space(*p)) ++p;
+        if (p != end) throw std::runtime_error("Parse error");
+        return chunks;
     }
-    bool EndArray(SizeType elementCount)
+
+    /**Parse the elements of a top level array on up to threads workers.*/
+    void parse_array_parallel(const char *str, size_t len, ReaderLinesHandler &handler, unsigned threads)
     {
-        stack.top()->end_array();
-        stack.pop();
-        return true;
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t target = std::max(LINES_MIN_CHUNK, len / ((size_t)threads * 4) + 1);
+
+        std::vector<std::pair<size_t, size_t>> chunks;
+        {
+            RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(JsonStatsScope::current(), &JsonStats::parse_ns);)
+            chunks = split_array(str, len, target);
+        }
+        bool allow_empty = chunks.size() == 1;
+        handler.start(chunks.size());
+        parse_chunks_parallel(chunks.size(), threads, [&](size_t i)
+        {
+            parse_array_chunk(str + chunks[i].first, chunks[i].second - chunks[i].first, handler, i, allow_empty);
+        });
+        RAPIDJSON_EXT_STATS_ONLY(if (auto stats = JsonStatsScope::current()) ++stats->documents_read;)
     }
-};
+}
+
+void rapidjson_ext_detail::throw_out_of_range()
+{
+    throw ReaderError("Out of range");
+}
+
+size_t ReaderFdStream::read(char *buffer, size_t len)
+{
+#ifdef _WIN32
+    if (len > INT_MAX) len = INT_MAX;
+    int ret = ::_read(fd, buffer, (unsigned)len);
+#else
+    ssize_t ret;
+    do
+    {
+        ret = ::read(fd, buffer, len);
+    } while (ret < 0 && errno == EINTR);
+#endif
+    if (ret < 0) throw std::runtime_error("File read error");
+    return (size_t)ret;
+}
 
 void read_json(const std::string &str, std::unique_ptr<ReaderFrame> &&root)
 {
-    Reader reader;
-    reader.stack.emplace(std::move(root));
-    
-    rapidjson::Reader json_reader;
-    rapidjson::StringStream ss(str.c_str());
-    if (!json_reader.Parse(ss, reader)) throw std::runtime_error("Parse error");
+    read_json(str.data(), str.size(), std::move(root));
+}
+
+void read_json(const char *str, size_t len, std::unique_ptr<ReaderFrame> &&root)
+{
+    ReaderStream ss(str, len);
+    parse(ss, std::move(root));
+}
+
+void read_json(std::istream &is, std::unique_ptr<ReaderFrame> &&root, size_t buffer_size)
+{
+    ReaderIStream ss(is, buffer_size);
+    parse(ss, std::move(root));
+}
+
+void read_json_fd(int fd, std::unique_ptr<ReaderFrame> &&root, size_t buffer_size)
+{
+    ReaderFdStream ss(fd, buffer_size);
+    parse(ss, std::move(root));
+}
+
+void read_json_file(const std::string &path, std::unique_ptr<ReaderFrame> &&root)
+{
+    MappedFile file(path);
+    read_json(file.data(), file.size(), std::move(root));
+}
+
+void read_json_insitu(char *str, std::unique_ptr<ReaderFrame> &&root)
+{
+    rapidjson::InsituStringStream ss(str);
+    parse<rapidjson::kParseInsituFlag>(ss, std::move(root));
+}
+
+void read_json_insitu(std::string &str, std::unique_ptr<ReaderFrame> &&root)
+{
+    read_json_insitu(str.data(), std::move(root));
+}
+
+void read_json_lines(const char *str, size_t len, ReaderLinesHandler &handler, unsigned threads)
+{
+    parse_lines_parallel(str, len, handler, threads);
+}
+
+void read_json_lines(const std::string &str, ReaderLinesHandler &handler, unsigned threads)
+{
+    parse_lines_parallel(str.data(), str.size(), handler, threads);
+}
+
+void read_json_lines_file(const std::string &path, ReaderLinesHandler &handler, unsigned threads)
+{
+    MappedFile file(path);
+    parse_lines_parallel(file.data(), file.size(), handler, threads);
+}
+
+void read_json_array_parallel(const char *str, size_t len, ReaderLinesHandler &handler, unsigned threads)
+{
+    parse_array_parallel(str, len, handler, threads);
+}
+
+void read_json_array_parallel(const std::string &str, ReaderLinesHandler &handler, unsigned threads)
+{
+    parse_array_parallel(str.data(), str.size(), handler, threads);
+}
+
+void read_json_array_parallel_file(const std::string &path, ReaderLinesHandler &handler, unsigned threads)
+{
+    MappedFile file(path);
+    parse_array_parallel(file.data(), file.size(), handler, threads);
 }
@@ -0,0 +1,122 @@
+#include "ReaderArena.hpp"
+#include "Reader.hpp"
+#include "JsonStatsHooks.hpp"
+#include <cassert>
+#include <new>
+
+namespace
+{
+    thread_local ReaderArena *current_arena = nullptr;
+
+    /**Prefixed to every ReaderFrame allocation, so operator delete knows where it came from.*/
+    struct alignas(std::max_align_t) FrameHeader
+    {
+        /**Owning arena, or null if allocated on the heap.*/
+        ReaderArena *arena;
+        /**Allocation size including this header.*/
+        size_t size;
+    };
+
+    size_t align_size(size_t size)
+    {
+        const size_t align = alignof(std::max_align_t);
+        return (size + align - 1) & ~(align - 1);
+    }
+}
+
+ReaderArena::ReaderArena()
+    : blocks(), block(0), live(0)
+{
+}
+
+ReaderArena::~ReaderArena()
+{
+    assert(live == 0);
+}
+
+void *ReaderArena::allocate(size_t size)
+{
+    size = align_size(size);
+    while (block < blocks.size())
+    {
+        auto &b = blocks[block];
+        if (b.size - b.used >= size)
+        {
+            void *p = b.data.get() + b.used;
+            b.used += size;
+            ++live;
+            return p;
+        }
+        if (block + 1 == blocks.size()) break;
+        ++block;
+    }
+    // Out of blocks, add a new one large enough for this allocation
+    Block b;
+    b.size = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+    b.data.reset(new char[b.size]);
+    b.used = size;
+    blocks.push_back(std::move(b));
+    block = blocks.size() - 1;
+    ++live;
+    return blocks.back().data.get();
+}
+
+void ReaderArena::deallocate(void *p, size_t size)
+{
+    assert(live > 0);
+    if (--live == 0)
+    {
+        // Nothing left, reclaim everything including out of order frees
+        for (auto &b : blocks) b.used = 0;
+        block = 0;
+        return;
+    }
+    size = align_size(size);
+    auto &b = blocks[block];
+    if ((char*)p + size == b.data.get() + b.used)
+    {
+        b.used -= size;
+        if (b.used == 0 && block > 0) --block;
+    }
+}
+
+ReaderArena *ReaderArena::current()
+{
+    return current_arena;
+}
+
+ReaderArena &ReaderArena::thread_arena()
+{
+    thread_local ReaderArena arena;
+    return arena;
+}
+
+ReaderArena::Scope::Scope(ReaderArena &arena)
+    : prev(current_arena)
+{
+    current_arena = &arena;
+}
+
+ReaderArena::Scope::~Scope()
+{
+    current_arena = prev;
+}
+
+void *ReaderFrame::operator new(size_t size)
+{
+    RAPIDJSON_EXT_STATS_ONLY(if (auto stats = JsonStatsScope::current()) ++stats->frames;)
+    size += sizeof(FrameHeader);
+    auto arena = ReaderArena::current();
+    auto header = (FrameHeader*)(arena ? arena->allocate(size) : ::operator new(size));
+    header->arena = arena;
+    header->size = size;
+    return header + 1;
+}
+
+void ReaderFrame::operator delete(void *p)
+{
+    if (!p) return;
+    auto header = (FrameHeader*)p - 1;
+    if (header->arena) header->arena->deallocate(header, header->size);
+    else ::operator delete(header);
+}
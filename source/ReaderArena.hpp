@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**Bump allocator for the ReaderFrame objects created while parsing a document.
+ *
+ * Frames are created and destroyed in stack order as the parser descends and returns, so
+ * freeing the most recent allocation simply moves the bump pointer back. Anything freed out of
+ * order is reclaimed when the last live allocation is freed, which resets the arena for the next
+ * document while keeping its blocks, so a warmed up arena makes no heap allocations.
+ *
+ * An arena is not thread safe. Frames allocated from it must be destroyed on the same thread.
+ */
+class ReaderArena
+{
+public:
+    ReaderArena();
+    ~ReaderArena();
+
+    ReaderArena(const ReaderArena &) = delete;
+    ReaderArena& operator = (const ReaderArena &) = delete;
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    /**Arena used by ReaderFrame::operator new on this thread, or null for the heap.*/
+    static ReaderArena *current();
+    /**Arena owned by this thread, used by read_json.*/
+    static ReaderArena &thread_arena();
+
+    /**Sets the current arena for the lifetime of the scope.*/
+    class Scope
+    {
+    public:
+        explicit Scope(ReaderArena &arena);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope& operator = (const Scope &) = delete;
+    private:
+        ReaderArena *prev;
+    };
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+        size_t used;
+    };
+    static const size_t BLOCK_SIZE = 16 * 1024;
+
+    std::vector<Block> blocks;
+    /**Index of the block being allocated from.*/
+    size_t block;
+    /**Number of allocations not yet freed.*/
+    size_t live;
+};
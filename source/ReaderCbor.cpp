@@ -0,0 +1,267 @@
+#include "Reader.hpp"
+#include "ReaderArena.hpp"
+#include "ReaderHandler.hpp"
+#include "JsonStatsHooks.hpp"
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    /**Decodes a CBOR value, passing the same events to a Reader as rapidjson would for the
+     * equivalent JSON. Arrays and maps are tracked on an explicit stack rather than by recursion,
+     * so deeply nested input cannot overflow the call stack.
+     */
+    class CborDecoder
+    {
+    public:
+        CborDecoder(const char *data, size_t len)
+            : begin((const unsigned char*)data), p(begin), end(begin + len), containers(), chunks()
+        {}
+
+        void parse(Reader &reader)
+        {
+            item(reader);
+            while (!containers.empty())
+            {
+                auto &c = containers.back();
+                bool done = c.indefinite ? peek() == 0xFF : c.remaining == 0;
+                if (done)
+                {
+                    if (c.indefinite) ++p;
+                    if (c.map)
+                    {
+                        // An indefinite map must not end between a key and its value
+                        if (!c.key_next) error();
+                        reader.EndObject(0);
+                    }
+                    else reader.EndArray(0);
+                    containers.pop_back();
+                    continue;
+                }
+                if (!c.indefinite) --c.remaining;
+                if (c.map)
+                {
+                    c.key_next = !c.key_next;
+                    if (!c.key_next)
+                    {
+                        key(reader);
+                        continue;
+                    }
+                }
+                item(reader);
+            }
+            if (p != end) error();
+        }
+
+        size_t tell()const { return (size_t)(p - begin); }
+    private:
+        struct Container
+        {
+            /**Items left in a definite length container, counting keys and values separately.*/
+            uint64_t remaining;
+            bool indefinite;
+            bool map;
+            /**The next item of a map is a key.*/
+            bool key_next;
+        };
+
+        [[noreturn]] static void error()
+        {
+            throw std::runtime_error("Parse error");
+        }
+
+        unsigned char peek()const
+        {
+            if (p == end) error();
+            return *p;
+        }
+        unsigned char byte()
+        {
+            if (p == end) error();
+            return *p++;
+        }
+        /**Big endian unsigned integer of n bytes.*/
+        uint64_t read_uint(size_t n)
+        {
+            if ((size_t)(end - p) < n) error();
+            uint64_t x = 0;
+            for (size_t i = 0; i < n; ++i) x = (x << 8) | p[i];
+            p += n;
+            return x;
+        }
+        /**Argument following an initial byte with additional information ai.*/
+        uint64_t argument(unsigned ai)
+        {
+            if (ai < 24) return ai;
+            if (ai > 27) error();
+            return read_uint((size_t)1 << (ai - 24));
+        }
+        /**Read a text string. Indefinite length strings are joined in chunks.*/
+        std::string_view text(unsigned char initial)
+        {
+            if ((initial >> 5) != 3) error();
+            unsigned ai = initial & 31;
+            if (ai != 31) return definite_text(argument(ai));
+            chunks.clear();
+            while (peek() != 0xFF)
+            {
+                unsigned char chunk = byte();
+                if ((chunk >> 5) != 3 || (chunk & 31) == 31) error();
+                auto str = definite_text(argument(chunk & 31));
+                chunks.append(str.data(), str.size());
+            }
+            ++p;
+            return chunks;
+        }
+        std::string_view definite_text(uint64_t len)
+        {
+            if ((uint64_t)(end - p) < len || len > UINT_MAX) error();
+            std::string_view str((const char*)p, (size_t)len);
+            p += len;
+            return str;
+        }
+
+        void key(Reader &reader)
+        {
+            auto str = text(byte());
+            reader.Key(str.data(), (rapidjson::SizeType)str.size(), true);
+        }
+
+        /**Read a value, starting an array or map if it is one.*/
+        void item(Reader &reader)
+        {
+            unsigned char initial = byte();
+            unsigned ai = initial & 31;
+            // Tags only annotate the following item
+            while ((initial >> 5) == 6)
+            {
+                argument(ai);
+                initial = byte();
+                ai = initial & 31;
+            }
+            switch (initial >> 5)
+            {
+            case 0:
+            {
+                uint64_t n = argument(ai);
+                if (n <= UINT_MAX) reader.Uint((unsigned)n);
+                else reader.Uint64(n);
+                break;
+            }
+            case 1:
+            {
+                // The value is -1 - n, which as for JSON is a double below INT64_MIN
+                uint64_t n = argument(ai);
+                if (n <= (uint64_t)INT_MAX) reader.Int(-1 - (int)n);
+                else if (n <= (uint64_t)INT64_MAX) reader.Int64(-1 - (int64_t)n);
+                else reader.Double(-1.0 - (double)n);
+                break;
+            }
+            case 3:
+            {
+                auto str = text(initial);
+                reader.String(str.data(), (rapidjson::SizeType)str.size(), true);
+                break;
+            }
+            case 4:
+            case 5:
+            {
+                bool map = (initial >> 5) == 5;
+                Container c = { 0, ai == 31, map, true };
+                if (!c.indefinite)
+                {
+                    c.remaining = argument(ai);
+                    if (map)
+                    {
+                        if (c.remaining > UINT64_MAX / 2) error();
+                        c.remaining *= 2;
+                    }
+                }
+                if (map) reader.StartObject();
+                else reader.StartArray();
+                containers.push_back(c);
+                break;
+            }
+            case 7:
+                simple(reader, ai);
+                break;
+            default:
+                // Byte strings have no JSON equivalent
+                error();
+            }
+        }
+
+        void simple(Reader &reader, unsigned ai)
+        {
+            switch (ai)
+            {
+            case 20: reader.Bool(false); break;
+            case 21: reader.Bool(true); break;
+            case 22:
+            case 23:
+                reader.Null();
+                break;
+            case 25: reader.Double(half_to_double((uint16_t)read_uint(2))); break;
+            case 26:
+            {
+                uint32_t bits = (uint32_t)read_uint(4);
+                float f;
+                std::memcpy(&f, &bits, 4);
+                reader.Double(f);
+                break;
+            }
+            case 27:
+            {
+                uint64_t bits = read_uint(8);
+                double d;
+                std::memcpy(&d, &bits, 8);
+                reader.Double(d);
+                break;
+            }
+            default:
+                error();
+            }
+        }
+
+        static double half_to_double(uint16_t h)
+        {
+            int exponent = (h >> 10) & 0x1F;
+            int mantissa = h & 0x3FF;
+            double d;
+            if (exponent == 0) d = std::ldexp(mantissa, -24);
+            else if (exponent != 31) d = std::ldexp(mantissa + 1024, exponent - 25);
+            else d = mantissa ? NAN : INFINITY;
+            return (h & 0x8000) ? -d : d;
+        }
+
+        const unsigned char *begin;
+        const unsigned char *p;
+        const unsigned char *end;
+        std::vector<Container> containers;
+        /**Joined chunks of an indefinite length string.*/
+        std::string chunks;
+    };
+}
+
+void read_cbor(const char *data, size_t len, std::unique_ptr<ReaderFrame> &&root)
+{
+    ReaderArena::Scope arena(ReaderArena::thread_arena());
+    Reader reader;
+    reader.stack.emplace(std::move(root));
+    RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(reader.stats, &JsonStats::parse_ns);)
+
+    CborDecoder decoder(data, len);
+    decoder.parse(reader);
+    RAPIDJSON_EXT_STATS_ONLY(if (reader.stats)
+    {
+        ++reader.stats->documents_read;
+        reader.stats->bytes_read += decoder.tell();
+    })
+}
+
+void read_cbor(const std::string &data, std::unique_ptr<ReaderFrame> &&root)
+{
+    read_cbor(data.data(), data.size(), std::move(root));
+}
@@ -0,0 +1,143 @@
+#include "ReaderCursor.hpp"
+#include "ReaderArena.hpp"
+#include "ReaderHandler.hpp"
+#include "JsonStatsHooks.hpp"
+#include "ReaderStream.hpp"
+#include <rapidjson/reader.h>
+
+/**Root frame of a ReaderArrayCursor.
+ * Passes each element to the cursor's element frames, and notes when one is complete.
+ */
+class ReaderCursorFrame : public ReaderFrame
+{
+public:
+    explicit ReaderCursorFrame(ReaderArrayCursor *cursor)
+        : ready(false), element_open(false), cursor(cursor), in_array(false)
+    {}
+
+    virtual bool is_array()const override { return true; }
+    virtual std::unique_ptr<ReaderFrame> start_array()override
+    {
+        if (!in_array)
+        {
+            in_array = true;
+            return nullptr;
+        }
+        return open_element();
+    }
+    virtual void end_array()override
+    {
+        if (!in_array) throw ReaderError("Unexpected array end");
+        in_array = false;
+    }
+    virtual std::unique_ptr<ReaderFrame> start_object()override
+    {
+        return open_element();
+    }
+
+    virtual void value_null()override { scalar()->value_null(); }
+    virtual void value_bool(bool b)override { scalar()->value_bool(b); }
+    virtual void value_int(int i)override { scalar()->value_int(i); }
+    virtual void value_uint(unsigned i)override { scalar()->value_uint(i); }
+    virtual void value_int64(int64_t i)override { scalar()->value_int64(i); }
+    virtual void value_uint64(uint64_t i)override { scalar()->value_uint64(i); }
+    virtual void value_double(double d)override { scalar()->value_double(d); }
+    virtual void value_string(std::string_view str)override { scalar()->value_string(str); }
+
+    /**A scalar element has been read.*/
+    bool ready;
+    /**An object or array element has started, and is complete once its frame is popped.*/
+    bool element_open;
+private:
+    std::unique_ptr<ReaderFrame> open_element()
+    {
+        if (!in_array) throw ReaderError("Expected array");
+        cursor->clear_element();
+        element_open = true;
+        return cursor->element_reader();
+    }
+    ReaderFrame *scalar()
+    {
+        if (!in_array) throw ReaderError("Expected array");
+        if (!scalar_reader) scalar_reader = cursor->element_reader();
+        cursor->clear_element();
+        ready = true;
+        return scalar_reader.get();
+    }
+
+    ReaderArrayCursor *cursor;
+    bool in_array;
+    std::unique_ptr<ReaderFrame> scalar_reader;
+};
+
+struct ReaderArrayCursor::Impl
+{
+    /**Declared first so the frames are destroyed before it.*/
+    ReaderArena arena;
+    std::unique_ptr<ReaderStream> stream;
+    Reader reader;
+    rapidjson::Reader json_reader;
+    ReaderCursorFrame *root;
+
+    Impl(ReaderArrayCursor *cursor, std::unique_ptr<ReaderStream> &&stream)
+        : arena(), stream(std::move(stream)), reader(), json_reader(), root(nullptr)
+    {
+        ReaderArena::Scope scope(arena);
+        auto frame = std::make_unique<ReaderCursorFrame>(cursor);
+        root = frame.get();
+        reader.stream = this->stream.get();
+        reader.stack.emplace(std::move(frame));
+        json_reader.IterativeParseInit();
+    }
+};
+
+ReaderArrayCursor::ReaderArrayCursor(const char *str, size_t len)
+    : impl(new Impl(this, std::make_unique<ReaderStream>(str, len)))
+{
+}
+
+ReaderArrayCursor::ReaderArrayCursor(std::istream &is, size_t buffer_size)
+    : impl(new Impl(this, std::make_unique<ReaderIStream>(is, buffer_size)))
+{
+}
+
+ReaderArrayCursor::~ReaderArrayCursor()
+{
+}
+
+bool ReaderArrayCursor::next()
+{
+    ReaderArena::Scope scope(impl->arena);
+    auto &reader = impl->reader;
+    auto &json_reader = impl->json_reader;
+    RAPIDJSON_EXT_STATS_ONLY(reader.stats = JsonStatsScope::current();)
+    RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(reader.stats, &JsonStats::parse_ns);)
+    while (!json_reader.IterativeParseComplete())
+    {
+        if (!json_reader.IterativeParseNext<rapidjson::kParseDefaultFlags>(*impl->stream, reader))
+            throw std::runtime_error("Parse error");
+        // The root frame is popped at the end of the array
+        if (reader.stack.depth() == 0)
+        {
+            RAPIDJSON_EXT_STATS_ONLY(if (reader.stats)
+            {
+                ++reader.stats->documents_read;
+                reader.stats->bytes_read += impl->stream->Tell();
+            })
+            break;
+        }
+
+        auto root = impl->root;
+        if (root->ready)
+        {
+            root->ready = false;
+            return true;
+        }
+        if (root->element_open && reader.stack.depth() == 1)
+        {
+            root->element_open = false;
+            return true;
+        }
+    }
+    return false;
+}
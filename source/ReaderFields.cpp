@@ -0,0 +1,55 @@
+#include "ReaderFields.hpp"
+#include <stdexcept>
+
+const size_t ReaderKeyTable::npos;
+
+void ReaderKeyTable::build(const std::vector<std::pair<const char*, size_t>> &keys)
+{
+    slots.clear();
+    if (keys.empty()) return;
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (keys[i].second == keys[j].second && std::memcmp(keys[i].first, keys[j].first, keys[i].second) == 0)
+                throw std::invalid_argument("Duplicate key " + std::string(keys[i].first, keys[i].second));
+        }
+    }
+
+    // At least twice as many slots as keys
+    unsigned bits = 1;
+    while (((size_t)1 << bits) < keys.size() * 2) ++bits;
+
+    const Slot empty = { nullptr, (size_t)-1, npos };
+    std::vector<Slot> candidate;
+    for (;; ++bits)
+    {
+        if (bits > 24) throw std::invalid_argument("Failed to build key table");
+        for (int full = 0; full < 2; ++full)
+        {
+            for (uint32_t seed = 0; seed < 256; ++seed)
+            {
+                // Any odd multiplier is a valid multiplicative hash
+                uint32_t mult = 0x9E3779B1u + seed * 2;
+                unsigned sh = 32 - bits;
+                candidate.assign((size_t)1 << bits, empty);
+                bool ok = true;
+                for (size_t i = 0; i < keys.size() && ok; ++i)
+                {
+                    auto &slot = candidate[hash(keys[i].first, keys[i].second, full != 0, mult, sh)];
+                    if (slot.key) ok = false;
+                    else slot = { keys[i].first, keys[i].second, i };
+                }
+                if (ok)
+                {
+                    slots.swap(candidate);
+                    full_hash = full != 0;
+                    multiplier = mult;
+                    shift = sh;
+                    return;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,239 @@
+#pragma once
+#include "Reader.hpp"
+#include "JsonStatsHooks.hpp"
+#include "ReaderStream.hpp"
+#include <rapidjson/reader.h>
+#include <memory>
+#include <vector>
+
+/**Contiguous stack of the frames being parsed, indexed by depth.
+ * The storage is taken from a per-thread spare and given back when the stack is destroyed, so
+ * after the first document on a thread, only documents deeper than any before them allocate.
+ * A stack created while another is alive on the same thread, such as a ReaderCursor's, allocates
+ * its own.
+ */
+class ReaderFrameStack
+{
+public:
+    ReaderFrameStack()
+    {
+        frames.swap(spare());
+        if (frames.capacity() == 0) frames.reserve(32);
+    }
+    ~ReaderFrameStack()
+    {
+        frames.clear();
+        if (frames.capacity() > spare().capacity()) frames.swap(spare());
+    }
+
+    ReaderFrameStack(const ReaderFrameStack &) = delete;
+    ReaderFrameStack& operator = (const ReaderFrameStack &) = delete;
+
+    ReaderFrame *top() { return frames.back().get(); }
+    void push(std::unique_ptr<ReaderFrame> &&frame) { frames.push_back(std::move(frame)); }
+    void emplace(std::unique_ptr<ReaderFrame> &&frame) { frames.push_back(std::move(frame)); }
+    void pop() { frames.pop_back(); }
+    size_t depth()const { return frames.size(); }
+private:
+    typedef std::vector<std::unique_ptr<ReaderFrame>> Frames;
+    static Frames &spare()
+    {
+        thread_local Frames frames;
+        return frames;
+    }
+
+    Frames frames;
+};
+
+/**Throw unless json is a single valid JSON value, such as text for JsonWriter::value_raw.*/
+void json_validate(std::string_view json);
+
+/**rapidjson SAX handler passing each event to the ReaderFrame on top of the stack.*/
+class Reader
+{
+public:
+    ReaderFrameStack stack;
+    /**Input stream, if it supports skipping values. Otherwise skipped values are parsed into a
+     * ReaderDiscard.
+     */
+    ReaderStream *stream;
+    /**The next null is the placeholder for a skipped value, or for elements read by
+     * ReaderFrame::read_elements.
+     */
+    bool skipped;
+#ifdef RAPIDJSON_EXT_STATS
+    /**Stats to collect, JsonStatsScope::current when the Reader was created unless updated.*/
+    JsonStats *stats;
+#endif
+
+    Reader() : stack(), stream(nullptr), skipped(false)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(stats = JsonStatsScope::current();)
+    }
+    ~Reader() {}
+
+    bool RawNumber(const char* str, rapidjson::SizeType length, bool copy)
+    {
+        std::terminate();
+    }
+
+    bool Null()
+    {
+        if (skipped)
+        {
+            skipped = false;
+            if (stack.top()->is_array()) read_elements(true);
+            return true;
+        }
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->value_null();
+        if (!stack.top()->is_array()) stack.pop();
+        return true;
+    }
+    bool Bool(bool b)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->value_bool(b);
+        if (!stack.top()->is_array()) stack.pop();
+        return true;
+    }
+    bool Int(int i)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->value_int(i);
+        if (!stack.top()->is_array()) stack.pop();
+        else read_elements(true);
+        return true;
+    }
+    bool Uint(unsigned i)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->value_uint(i);
+        if (!stack.top()->is_array()) stack.pop();
+        else read_elements(true);
+        return true;
+    }
+    bool Int64(int64_t i)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->value_int64(i);
+        if (!stack.top()->is_array()) stack.pop();
+        else read_elements(true);
+        return true;
+    }
+    bool Uint64(uint64_t i)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->value_uint64(i);
+        if (!stack.top()->is_array()) stack.pop();
+        else read_elements(true);
+        return true;
+    }
+    bool Double(double d)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->value_double(d);
+        if (!stack.top()->is_array()) stack.pop();
+        else read_elements(true);
+        return true;
+    }
+    bool String(const char* str, rapidjson::SizeType length, bool copy)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        RAPIDJSON_EXT_STATS_ONLY(if (stats) stats->string_bytes += length;)
+        stack.top()->value_string(std::string_view(str, (size_t)length));
+        if (!stack.top()->is_array()) stack.pop();
+        return true;
+    }
+    bool StartObject()
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        auto next = stack.top()->start_object();
+        if (next)
+        {
+            next->start_object();
+            stack.push(std::move(next));
+            RAPIDJSON_EXT_STATS_ONLY(pushed();)
+        }
+        return true;
+    }
+    bool Key(const char* str, rapidjson::SizeType length, bool copy)
+    {
+        std::unique_ptr<ReaderFrame> next;
+        {
+            RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+            RAPIDJSON_EXT_STATS_ONLY(if (stats) stats->string_bytes += length;)
+            next = stack.top()->key(std::string_view(str, (size_t)length));
+        }
+        std::string *raw = next && stream ? next->raw_text() : nullptr;
+        if (raw)
+        {
+            // Capture the value's text as it is skipped, which checks it as strictly as parsing
+            stream->skip_value(raw);
+            skipped = true;
+        }
+        else if (next)
+        {
+            stack.emplace(std::move(next));
+            RAPIDJSON_EXT_STATS_ONLY(pushed();)
+        }
+        else if (stream)
+        {
+            stream->skip_value();
+            skipped = true;
+        }
+        else stack.emplace(std::make_unique<ReaderDiscard>());
+        return true;
+    }
+    bool EndObject(rapidjson::SizeType memberCount)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->end_object();
+        if (!stack.top()->is_array()) stack.pop();
+        return true;
+    }
+    bool StartArray()
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        auto next = stack.top()->start_array();
+        if (next)
+        {
+            next->start_array();
+            stack.push(std::move(next));
+            RAPIDJSON_EXT_STATS_ONLY(pushed();)
+        }
+        read_elements(false);
+        return true;
+    }
+    bool EndArray(rapidjson::SizeType elementCount)
+    {
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(stats, &JsonStats::callback_ns);)
+        stack.top()->end_array();
+        stack.pop();
+        return true;
+    }
+private:
+    /**Let the array frame on top read elements straight from the input, see
+     * ReaderFrame::read_elements. after_value is false just after the '['.
+     */
+    void read_elements(bool after_value)
+    {
+        if (!stream) return;
+        auto text = stream->chunk();
+        size_t used = stack.top()->read_elements(text.data(), text.size(), after_value);
+        if (!used) return;
+        stream->advance(used);
+        // After the '[' the parser expects a value, so give it one to swallow
+        if (!after_value)
+        {
+            stream->inject_null();
+            skipped = true;
+        }
+    }
+#ifdef RAPIDJSON_EXT_STATS
+    void pushed()
+    {
+        if (stats && stack.depth() > stats->max_depth) stats->max_depth = stack.depth();
+    }
+#endif
+};
@@ -0,0 +1,185 @@
+#include "ReaderPush.hpp"
+#include "ReaderArena.hpp"
+#include "ReaderHandler.hpp"
+#include "JsonStatsHooks.hpp"
+#include "ReaderStream.hpp"
+#include <rapidjson/reader.h>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    const unsigned PUSH_PARSE_FLAGS = rapidjson::kParseStopWhenDoneFlag;
+
+    bool is_space(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    const char *skip_space(const char *p, const char *end)
+    {
+        while (p != end && is_space(*p)) ++p;
+        return p;
+    }
+
+    /**Finds whether buffered input holds a complete parser step.
+     *
+     * IterativeParseNext treats the end of its input as the end of the document, so it must
+     * only be called once the whole of its next step is available: a token, plus the token
+     * after it if the first is a ',' or ':' delimiter. A long string is scanned once, however
+     * many fragments it arrives in.
+     */
+    class StepScanner
+    {
+    public:
+        StepScanner() : resume(0), escape(false) {}
+
+        bool complete(const char *begin, const char *end)
+        {
+            const char *p = skip_space(begin, end);
+            if (p == end) return false;
+            if (*p == ',' || *p == ':')
+            {
+                p = skip_space(p + 1, end);
+                if (p == end) return false;
+            }
+            switch (*p)
+            {
+            case '{': case '}': case '[': case ']': case ',': case ':':
+                return true;
+            case '"':
+                return string_complete(begin, p + 1, end);
+            case 't': case 'n':
+                return end - p >= 4;
+            case 'f':
+                return end - p >= 5;
+            default:
+                // A number is only complete once something follows it
+                while (p != end && ((*p >= '0' && *p <= '9') ||
+                    *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+                {
+                    ++p;
+                }
+                return p != end;
+            }
+        }
+
+        /**Call when the start of the input moves, after a step has been parsed.*/
+        void reset()
+        {
+            resume = 0;
+            escape = false;
+        }
+    private:
+        bool string_complete(const char *begin, const char *p, const char *end)
+        {
+            p = std::max(p, begin + resume);
+            for (; p != end; ++p)
+            {
+                if (escape) escape = false;
+                else if (*p == '\\') escape = true;
+                else if (*p == '"') return true;
+            }
+            resume = (size_t)(end - begin);
+            return false;
+        }
+
+        /**Offset from the start of the input that a string scan got to.*/
+        size_t resume;
+        /**The scan stopped after a backslash.*/
+        bool escape;
+    };
+}
+
+struct JsonPushReader::Impl
+{
+    /**Declared first so the frames are destroyed before it.*/
+    ReaderArena arena;
+    Reader reader;
+    rapidjson::Reader json_reader;
+    StepScanner scanner;
+    /**Input not yet parsed, held between calls to feed.*/
+    std::vector<char> pending;
+
+    explicit Impl(std::unique_ptr<ReaderFrame> &&root)
+    {
+        reader.stack.emplace(std::move(root));
+        json_reader.IterativeParseInit();
+    }
+
+    bool done()const
+    {
+        return json_reader.IterativeParseComplete();
+    }
+
+    /**Parse every complete step in [begin, end), returning the number of bytes consumed.
+     * At the end of the input, the rest is parsed regardless.
+     */
+    size_t parse(const char *begin, size_t len, bool end_of_input)
+    {
+        ReaderArena::Scope scope(arena);
+        ReaderStream ss(begin, len);
+        RAPIDJSON_EXT_STATS_ONLY(reader.stats = JsonStatsScope::current();)
+        RAPIDJSON_EXT_STATS_ONLY(JsonStatsTimer timer(reader.stats, &JsonStats::parse_ns);)
+        while (!done())
+        {
+            if (!end_of_input && !scanner.complete(begin + ss.Tell(), begin + len)) break;
+            if (!json_reader.IterativeParseNext<PUSH_PARSE_FLAGS>(ss, reader))
+                throw std::runtime_error("Parse error");
+            scanner.reset();
+        }
+        if (done())
+        {
+            // Only whitespace may follow the document
+            if (skip_space(begin + ss.Tell(), begin + len) != begin + len)
+                throw std::runtime_error("Parse error");
+            RAPIDJSON_EXT_STATS_ONLY(if (reader.stats)
+            {
+                ++reader.stats->documents_read;
+                reader.stats->bytes_read += len;
+            })
+            return len;
+        }
+        RAPIDJSON_EXT_STATS_ONLY(if (reader.stats) reader.stats->bytes_read += ss.Tell();)
+        return ss.Tell();
+    }
+};
+
+JsonPushReader::JsonPushReader(std::unique_ptr<ReaderFrame> &&root)
+    : impl(new Impl(std::move(root)))
+{
+}
+
+JsonPushReader::~JsonPushReader()
+{
+}
+
+void JsonPushReader::feed(const char *data, size_t len)
+{
+    if (impl->pending.empty())
+    {
+        // Parse straight from the caller's data, keeping only an incomplete step at the end
+        size_t used = impl->parse(data, len, false);
+        impl->pending.assign(data + used, data + len);
+    }
+    else
+    {
+        auto &pending = impl->pending;
+        pending.insert(pending.end(), data, data + len);
+        size_t used = impl->parse(pending.data(), pending.size(), false);
+        pending.erase(pending.begin(), pending.begin() + used);
+    }
+}
+
+void JsonPushReader::finish()
+{
+    auto &pending = impl->pending;
+    impl->parse(pending.data(), pending.size(), true);
+    pending.clear();
+    if (!impl->done()) throw std::runtime_error("Parse error");
+}
+
+bool JsonPushReader::done()const
+{
+    return impl->done();
+}
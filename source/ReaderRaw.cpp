@@ -0,0 +1,131 @@
+#include "Reader.hpp"
+#include "ReaderHandler.hpp"
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+namespace
+{
+    typedef rapidjson::Writer<rapidjson::StringBuffer> RawWriter;
+
+    /**Writes the events of a value back out as JSON. Like ReaderDiscard, a frame is the value
+     * it was created for, and array elements and the values of keys get frames of their own.
+     */
+    class ReaderRawValue : public ReaderFrame
+    {
+    public:
+        explicit ReaderRawValue(RawWriter *writer) : writer(writer), in_array(false) {}
+        virtual bool is_array()const override { return in_array; }
+
+        virtual void value_null()override { writer->Null(); done(); }
+        virtual void value_bool(bool b)override { writer->Bool(b); done(); }
+        virtual void value_int(int i)override { writer->Int(i); done(); }
+        virtual void value_uint(unsigned i)override { writer->Uint(i); done(); }
+        virtual void value_int64(int64_t i)override { writer->Int64(i); done(); }
+        virtual void value_uint64(uint64_t i)override { writer->Uint64(i); done(); }
+        virtual void value_double(double d)override
+        {
+            // Only CBOR can give a NaN or infinity, which JSON cannot represent
+            if (!writer->Double(d)) throw ReaderError("Unexpected double");
+            done();
+        }
+        virtual void value_string(std::string_view str)override
+        {
+            writer->String(str.data(), (rapidjson::SizeType)str.size());
+            done();
+        }
+        virtual std::unique_ptr<ReaderFrame> start_array()override
+        {
+            if (in_array) return std::make_unique<ReaderRawValue>(writer);
+            writer->StartArray();
+            in_array = true;
+            return nullptr;
+        }
+        virtual void end_array()override
+        {
+            writer->EndArray();
+            in_array = false;
+            done();
+        }
+        virtual std::unique_ptr<ReaderFrame> start_object()override
+        {
+            if (in_array) return std::make_unique<ReaderRawValue>(writer);
+            writer->StartObject();
+            return nullptr;
+        }
+        virtual void end_object()override
+        {
+            writer->EndObject();
+            done();
+        }
+        virtual std::unique_ptr<ReaderFrame> key(std::string_view str)override
+        {
+            writer->Key(str.data(), (rapidjson::SizeType)str.size());
+            return std::make_unique<ReaderRawValue>(writer);
+        }
+    protected:
+        /**Called when a value in this frame is complete.*/
+        virtual void done() {}
+
+        RawWriter *writer;
+        bool in_array;
+    };
+
+    /**rapidjson SAX handler accepting any value, for json_validate.*/
+    struct ReaderValidator
+    {
+        bool Null() { return true; }
+        bool Bool(bool) { return true; }
+        bool Int(int) { return true; }
+        bool Uint(unsigned) { return true; }
+        bool Int64(int64_t) { return true; }
+        bool Uint64(uint64_t) { return true; }
+        bool Double(double) { return true; }
+        bool RawNumber(const char*, rapidjson::SizeType, bool) { return true; }
+        bool String(const char*, rapidjson::SizeType, bool) { return true; }
+        bool StartObject() { return true; }
+        bool Key(const char*, rapidjson::SizeType, bool) { return true; }
+        bool EndObject(rapidjson::SizeType) { return true; }
+        bool StartArray() { return true; }
+        bool EndArray(rapidjson::SizeType) { return true; }
+    };
+
+    /**Reader for RawJson, which owns the writer shared by the frames of its value.*/
+    class ReaderRawJson : public ReaderRawValue
+    {
+    public:
+        explicit ReaderRawJson(RawJson *out) : ReaderRawValue(&raw_writer), out(out), buffer(), raw_writer(buffer) {}
+
+        virtual std::string *raw_text()override
+        {
+            out->json.clear();
+            return &out->json;
+        }
+    protected:
+        virtual void done()override
+        {
+            // Elements of a top level array are not the end of the value
+            if (in_array) return;
+            out->json.assign(buffer.GetString(), buffer.GetSize());
+            // A list reuses the frame for each of its scalar elements
+            buffer.Clear();
+            raw_writer.Reset(buffer);
+        }
+    private:
+        RawJson *out;
+        rapidjson::StringBuffer buffer;
+        RawWriter raw_writer;
+    };
+}
+
+void json_validate(std::string_view json)
+{
+    ReaderStream ss(json.data(), json.size());
+    ReaderValidator validator;
+    rapidjson::Reader reader;
+    if (!reader.Parse<rapidjson::kParseDefaultFlags>(ss, validator)) throw std::runtime_error("Parse error");
+}
+
+std::unique_ptr<ReaderFrame> make_json_reader(RawJson *p)
+{
+    return std::make_unique<ReaderRawJson>(p);
+}
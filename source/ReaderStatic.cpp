@@ -0,0 +1,215 @@
+#include "ReaderStatic.hpp"
+#include "JsonStatsHooks.hpp"
+#include "ReaderStream.hpp"
+#include <rapidjson/reader.h>
+#include <new>
+
+/**rapidjson SAX handler storing each event as the current token of a JsonPullReader.*/
+struct JsonPullReader::Handler
+{
+    JsonPullReader *reader;
+
+    bool RawNumber(const char* str, rapidjson::SizeType length, bool copy)
+    {
+        std::terminate();
+    }
+
+    bool Null()
+    {
+        reader->current = Token::null_value;
+        return true;
+    }
+    bool Bool(bool b)
+    {
+        reader->current = Token::bool_value;
+        reader->b = b;
+        return true;
+    }
+    bool Int(int i)
+    {
+        return Int64(i);
+    }
+    bool Uint(unsigned i)
+    {
+        return Uint64(i);
+    }
+    bool Int64(int64_t i)
+    {
+        reader->current = Token::int_value;
+        reader->i = i;
+        return true;
+    }
+    bool Uint64(uint64_t i)
+    {
+        reader->current = Token::uint_value;
+        reader->u = i;
+        return true;
+    }
+    bool Double(double d)
+    {
+        reader->current = Token::double_value;
+        reader->d = d;
+        return true;
+    }
+    bool String(const char* str, rapidjson::SizeType length, bool copy)
+    {
+        reader->current = Token::string;
+        reader->str = std::string_view(str, (size_t)length);
+        RAPIDJSON_EXT_STATS_ONLY(if (auto stats = JsonStatsScope::current()) stats->string_bytes += length;)
+        return true;
+    }
+    bool StartObject()
+    {
+        reader->current = Token::start_object;
+        return true;
+    }
+    bool Key(const char* str, rapidjson::SizeType length, bool copy)
+    {
+        reader->current = Token::key;
+        reader->str = std::string_view(str, (size_t)length);
+        RAPIDJSON_EXT_STATS_ONLY(if (auto stats = JsonStatsScope::current()) stats->string_bytes += length;)
+        return true;
+    }
+    bool EndObject(rapidjson::SizeType memberCount)
+    {
+        reader->current = Token::end_object;
+        return true;
+    }
+    bool StartArray()
+    {
+        reader->current = Token::start_array;
+        return true;
+    }
+    bool EndArray(rapidjson::SizeType elementCount)
+    {
+        reader->current = Token::end_array;
+        return true;
+    }
+};
+
+struct JsonPullReader::Impl
+{
+    ReaderStream memory_stream;
+    std::unique_ptr<ReaderStream> owned_stream;
+    ReaderStream *stream;
+    rapidjson::Reader json_reader;
+    Handler handler;
+
+    Impl(JsonPullReader *reader, const char *str, size_t len)
+        : memory_stream(str, len), owned_stream(), stream(&memory_stream), json_reader(), handler{ reader }
+    {
+        json_reader.IterativeParseInit();
+    }
+    Impl(JsonPullReader *reader, std::unique_ptr<ReaderStream> &&stream)
+        : memory_stream(), owned_stream(std::move(stream)), stream(owned_stream.get()), json_reader(), handler{ reader }
+    {
+        json_reader.IterativeParseInit();
+    }
+};
+
+JsonPullReader::JsonPullReader(const char *str, size_t len)
+    : impl(nullptr), current(Token::none), b(false), i(0), u(0), d(0), str()
+{
+    static_assert(sizeof(Impl) <= IMPL_SIZE, "JsonPullReader::IMPL_SIZE too small");
+    static_assert(alignof(Impl) <= alignof(std::max_align_t), "JsonPullReader::Impl over aligned");
+    impl = new (impl_storage) Impl(this, str, len);
+}
+
+JsonPullReader::JsonPullReader(std::istream &is, size_t buffer_size)
+    : impl(nullptr), current(Token::none), b(false), i(0), u(0), d(0), str()
+{
+    impl = new (impl_storage) Impl(this, std::make_unique<ReaderIStream>(is, buffer_size));
+}
+
+JsonPullReader::~JsonPullReader()
+{
+    impl->~Impl();
+}
+
+JsonPullReader::Token JsonPullReader::next()
+{
+    auto &json_reader = impl->json_reader;
+    // Past the end of the document IterativeParseNext succeeds without producing a token
+    if (json_reader.IterativeParseComplete() ||
+        !json_reader.IterativeParseNext<rapidjson::kParseDefaultFlags>(*impl->stream, impl->handler))
+    {
+        throw std::runtime_error("Parse error");
+    }
+    return current;
+}
+
+void JsonPullReader::unexpected()const
+{
+    switch (current)
+    {
+    case Token::null_value: throw ReaderError("Unexpected null");
+    case Token::bool_value: throw ReaderError("Unexpected bool");
+    case Token::int_value: throw ReaderError("Unexpected int64");
+    case Token::uint_value: throw ReaderError("Unexpected uint64");
+    case Token::double_value: throw ReaderError("Unexpected double");
+    case Token::string: throw ReaderError("Unexpected string");
+    case Token::key: throw ReaderError("Unexpected key");
+    case Token::start_object: throw ReaderError("Unexpected object");
+    case Token::end_object: throw ReaderError("Unexpected object end");
+    case Token::start_array: throw ReaderError("Unexpected array");
+    case Token::end_array: throw ReaderError("Unexpected array end");
+    default: throw ReaderError("Unexpected end of document");
+    }
+}
+
+void JsonPullReader::skip_value()
+{
+    if (current == Token::key)
+    {
+        // The stream presents ":null" in place of the value
+        impl->stream->skip_value();
+        next();
+        return;
+    }
+    size_t depth = 0;
+    while (true)
+    {
+        switch (current)
+        {
+        case Token::start_object:
+        case Token::start_array:
+            ++depth;
+            break;
+        case Token::end_object:
+        case Token::end_array:
+            --depth;
+            break;
+        default:
+            break;
+        }
+        if (depth == 0) return;
+        next();
+    }
+}
+
+std::string_view JsonPullReader::raw_input()
+{
+    return impl->stream->chunk();
+}
+
+void JsonPullReader::consume_raw(size_t n, bool after_value)
+{
+    if (!n) return;
+    impl->stream->advance(n);
+    if (!after_value)
+    {
+        // After the '[' the parser expects a value, so give it one
+        impl->stream->inject_null();
+        next();
+    }
+}
+
+void JsonPullReader::finish()
+{
+    if (!impl->json_reader.IterativeParseComplete()) throw ReaderError("Expected end of document");
+    RAPIDJSON_EXT_STATS_ONLY(if (auto stats = JsonStatsScope::current())
+    {
+        ++stats->documents_read;
+        stats->bytes_read += impl->stream->Tell();
+    })
+}
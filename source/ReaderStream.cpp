@@ -0,0 +1,376 @@
+#include "ReaderStream.hpp"
+#include "Simd.hpp"
+#include <cstring>
+
+namespace
+{
+    const char SKIPPED_VALUE[] = ":null";
+    const char PLACEHOLDER_VALUE[] = "null";
+
+    bool is_space(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+    bool is_structural(char c)
+    {
+        // '[' ']' '{' '}' are 0x5B 0x5D 0x7B 0x7D
+        return c == '"' || (c | 0x20) == '{' || (c | 0x20) == '}';
+    }
+
+    [[noreturn]] void skip_error()
+    {
+        throw std::runtime_error("Parse error");
+    }
+
+    bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+    /**End of a number or literal.*/
+    bool ends_scalar(char c)
+    {
+        return is_space(c) || c == ',' || c == ']' || c == '}' || c == '\0';
+    }
+
+    /**First '"', '\\' or control character in [p, end), or end.*/
+    const char *find_string_special(const char *p, const char *end)
+    {
+#ifdef RAPIDJSON_EXT_SSE2
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1F);
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            // Unsigned v <= 0x1F
+            __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(v, control), v);
+            __m128i m = _mm_or_si128(low, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+            if (mask) return p + count_trailing_zeros(mask);
+        }
+#endif
+        while (p != end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) ++p;
+        return p;
+    }
+
+    /**Checks the grammar of a number or literal a character at a time, so it may span chunks.*/
+    class ScalarCheck
+    {
+    public:
+        explicit ScalarCheck(char c) : state(INVALID), rest(nullptr)
+        {
+            if (c == '-') state = MINUS;
+            else if (c == '0') state = ZERO;
+            else if (is_digit(c)) state = INT;
+            else if (c == 't') literal("rue");
+            else if (c == 'f') literal("alse");
+            else if (c == 'n') literal("ull");
+        }
+
+        /**Add the next character, returning false if it can not continue the value.*/
+        bool next(char c)
+        {
+            switch (state)
+            {
+            case MINUS: state = c == '0' ? ZERO : is_digit(c) ? INT : INVALID; break;
+            case ZERO: state = c == '.' ? DOT : is_exp(c) ? EXP_START : INVALID; break;
+            case INT: if (!is_digit(c)) state = c == '.' ? DOT : is_exp(c) ? EXP_START : INVALID; break;
+            case DOT: state = is_digit(c) ? FRAC : INVALID; break;
+            case FRAC: if (!is_digit(c)) state = is_exp(c) ? EXP_START : INVALID; break;
+            case EXP_START: state = c == '+' || c == '-' ? EXP_SIGN : is_digit(c) ? EXP : INVALID; break;
+            case EXP_SIGN: state = is_digit(c) ? EXP : INVALID; break;
+            case EXP: if (!is_digit(c)) state = INVALID; break;
+            case LITERAL: if (*rest && *rest == c) ++rest; else state = INVALID; break;
+            case INVALID: break;
+            }
+            return state != INVALID;
+        }
+        /**True if the characters so far are a whole number or literal.*/
+        bool complete()const
+        {
+            return state == ZERO || state == INT || state == FRAC || state == EXP ||
+                (state == LITERAL && !*rest);
+        }
+    private:
+        enum State { INVALID, MINUS, ZERO, INT, DOT, FRAC, EXP_START, EXP_SIGN, EXP, LITERAL };
+
+        static bool is_exp(char c) { return c == 'e' || c == 'E'; }
+        void literal(const char *r)
+        {
+            state = LITERAL;
+            rest = r;
+        }
+
+        State state;
+        /**Remaining characters of a literal.*/
+        const char *rest;
+    };
+
+    /**Kinds of the containers open while skipping, a bit per level, set for objects.
+     * The innermost 64 levels are kept in one word, and only deeper nesting allocates.
+     */
+    class BracketStack
+    {
+    public:
+        BracketStack() : bits(0), depth(0), outer() {}
+
+        void push(bool object)
+        {
+            if (depth != 0 && depth % 64 == 0)
+            {
+                outer.push_back(bits);
+                bits = 0;
+            }
+            bits = (bits << 1) | (object ? 1u : 0u);
+            ++depth;
+        }
+        void pop()
+        {
+            bits >>= 1;
+            --depth;
+            if (depth != 0 && depth % 64 == 0)
+            {
+                bits = outer.back();
+                outer.pop_back();
+            }
+        }
+        bool object()const { return (bits & 1) != 0; }
+        bool empty()const { return depth == 0; }
+    private:
+        uint64_t bits;
+        size_t depth;
+        std::vector<uint64_t> outer;
+    };
+}
+
+const char *json_find_string_end(const char *p, const char *end)
+{
+#ifdef RAPIDJSON_EXT_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+        if (mask) return p + count_trailing_zeros(mask);
+    }
+#endif
+    while (p != end && *p != '"' && *p != '\\') ++p;
+    return p;
+}
+
+const char *json_find_structural(const char *p, const char *end)
+{
+#ifdef RAPIDJSON_EXT_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i folded = _mm_or_si128(v, lower);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(m);
+        if (mask) return p + count_trailing_zeros(mask);
+    }
+#endif
+    while (p != end && !is_structural(*p)) ++p;
+    return p;
+}
+
+void ReaderStream::skip_value(std::string *raw)
+{
+    while (is_space(Peek())) Take();
+    if (Take() != ':') skip_error();
+    while (is_space(Peek())) Take();
+
+    capture = raw;
+    capture_start = src;
+    Ch c = Peek();
+    if (c == '"')
+    {
+        Take();
+        skip_string();
+    }
+    else if (c == '{' || c == '[')
+    {
+        Take();
+        skip_container(c == '{');
+    }
+    else if (c == '\0') skip_error();
+    else skip_scalar();
+    if (capture)
+    {
+        capture->append(capture_start, src);
+        capture = nullptr;
+    }
+    inject(SKIPPED_VALUE, sizeof(SKIPPED_VALUE) - 1);
+}
+
+void ReaderStream::inject_null()
+{
+    inject(PLACEHOLDER_VALUE, sizeof(PLACEHOLDER_VALUE) - 1);
+}
+
+void ReaderStream::inject(const char *text, size_t len)
+{
+    assert(!injected);
+    saved.begin = begin;
+    saved.src = src;
+    saved.end = end;
+    saved.offset = offset;
+    offset = Tell();
+    begin = src = text;
+    end = text + len;
+    injected = true;
+}
+
+bool ReaderStream::skip_next_chunk()
+{
+    if (capture) capture->append(capture_start, src);
+    bool more = next_chunk();
+    capture_start = src;
+    return more;
+}
+
+char ReaderStream::skip_take()
+{
+    if (src == end && !skip_next_chunk()) skip_error();
+    return *src++;
+}
+
+void ReaderStream::skip_scalar()
+{
+    ScalarCheck check(*src++);
+    while ((src != end || skip_next_chunk()) && !ends_scalar(*src))
+    {
+        if (!check.next(*src++)) skip_error();
+    }
+    if (!check.complete()) skip_error();
+}
+
+void ReaderStream::skip_string()
+{
+    while (true)
+    {
+        const char *p = find_string_special(src, end);
+        if (p == end)
+        {
+            src = end;
+            if (!skip_next_chunk()) skip_error();
+            continue;
+        }
+        src = p + 1;
+        if (*p == '"') return;
+        if (*p != '\\') skip_error(); // Control characters must be escaped
+        skip_escape();
+    }
+}
+
+void ReaderStream::skip_escape()
+{
+    auto hex4 = [this]()
+    {
+        unsigned code = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = skip_take();
+            char lower = (char)(c | 0x20);
+            if (is_digit(c)) code = code << 4 | (unsigned)(c - '0');
+            else if (lower >= 'a' && lower <= 'f') code = code << 4 | (unsigned)(lower - 'a' + 10);
+            else skip_error();
+        }
+        return code;
+    };
+    char c = skip_take();
+    if (c == 'u')
+    {
+        // As for rapidjson, a high surrogate must be followed by an escaped low surrogate
+        unsigned code = hex4();
+        if (code >= 0xD800 && code <= 0xDBFF)
+        {
+            if (skip_take() != '\\' || skip_take() != 'u') skip_error();
+            code = hex4();
+            if (code < 0xDC00 || code > 0xDFFF) skip_error();
+        }
+    }
+    else if (c == '\0' || !std::strchr("\"\\/bfnrt", c)) skip_error();
+}
+
+void ReaderStream::skip_container(bool object)
+{
+    enum Expect { VALUE_OR_CLOSE, VALUE, KEY_OR_CLOSE, KEY, COLON, COMMA_OR_CLOSE };
+    BracketStack stack;
+    stack.push(object);
+    Expect expect = object ? KEY_OR_CLOSE : VALUE_OR_CLOSE;
+    while (true)
+    {
+        if (src == end && !skip_next_chunk()) skip_error();
+        char c = *src;
+        if (is_space(c))
+        {
+            ++src;
+            continue;
+        }
+        bool close = false;
+        switch (expect)
+        {
+        case KEY_OR_CLOSE:
+        case KEY:
+            ++src;
+            if (c == '"')
+            {
+                skip_string();
+                expect = COLON;
+            }
+            else if (c == '}' && expect == KEY_OR_CLOSE) close = true;
+            else skip_error();
+            break;
+        case COLON:
+            ++src;
+            if (c != ':') skip_error();
+            expect = VALUE;
+            break;
+        case VALUE_OR_CLOSE:
+        case VALUE:
+            if (c == ']' && expect == VALUE_OR_CLOSE)
+            {
+                ++src;
+                close = true;
+            }
+            else if (c == '"')
+            {
+                ++src;
+                skip_string();
+                expect = COMMA_OR_CLOSE;
+            }
+            else if (c == '{' || c == '[')
+            {
+                ++src;
+                stack.push(c == '{');
+                expect = c == '{' ? KEY_OR_CLOSE : VALUE_OR_CLOSE;
+            }
+            else
+            {
+                skip_scalar();
+                expect = COMMA_OR_CLOSE;
+            }
+            break;
+        case COMMA_OR_CLOSE:
+            ++src;
+            if (c == ',') expect = stack.object() ? KEY : VALUE;
+            else if (c == (stack.object() ? '}' : ']')) close = true;
+            else skip_error();
+            break;
+        }
+        if (close)
+        {
+            stack.pop();
+            if (stack.empty()) return;
+            expect = COMMA_OR_CLOSE;
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**First '"' or '\\' in [p, end), or end.*/
+const char *json_find_string_end(const char *p, const char *end);
+/**First '"' or bracket in [p, end), or end.*/
+const char *json_find_structural(const char *p, const char *end);
+
+/**rapidjson input stream over one or more contiguous chunks of memory.
+ *
+ * Peek and Take only compare against the end of the current chunk. When the chunk is exhausted
+ * refill is called to provide the next one, so a single stream type (and a single instantiation
+ * of the rapidjson parser) serves in-memory, memory mapped and buffered inputs alike.
+ */
+class ReaderStream
+{
+public:
+    typedef char Ch;
+
+    ReaderStream()
+        : begin(nullptr), src(nullptr), end(nullptr), offset(0), injected(false), capture(nullptr), capture_start(nullptr)
+    {}
+    ReaderStream(const char *data, size_t len)
+        : begin(data), src(data), end(data + len), offset(0), injected(false), capture(nullptr), capture_start(nullptr)
+    {}
+    virtual ~ReaderStream() {}
+
+    Ch Peek()
+    {
+        return src != end || next_chunk() ? *src : '\0';
+    }
+    Ch Take()
+    {
+        return src != end || next_chunk() ? *src++ : '\0';
+    }
+    /**Number of bytes consumed from the start of the input.*/
+    size_t Tell()const
+    {
+        return offset + (size_t)(src - begin);
+    }
+
+    /**Skip the ':' and value following an object key without parsing it, then present ":null"
+     * to the parser in their place.
+     *
+     * The value is checked as strictly as the parser would, without the parser's events: bracket
+     * kinds are matched, strings are scanned for quotes, escapes and control characters, and
+     * numbers and literals are checked a character at a time.
+     *
+     * If raw is not null, the text of the value is appended to it, without the surrounding
+     * whitespace. A value spanning several chunks is copied a chunk at a time as it is skipped.
+     */
+    void skip_value(std::string *raw = nullptr);
+
+    /**The rest of the current chunk, for parsing directly. Empty at the end of the input.*/
+    std::string_view chunk()
+    {
+        Peek();
+        return std::string_view(src, (size_t)(end - src));
+    }
+    /**Consume n bytes of chunk.*/
+    void advance(size_t n)
+    {
+        assert(n <= (size_t)(end - src));
+        src += n;
+    }
+    /**Present "null" to the parser before the rest of the input, as a placeholder value.*/
+    void inject_null();
+
+    // In-situ parsing is not supported
+    Ch* PutBegin() { assert(false); return nullptr; }
+    void Put(Ch) { assert(false); }
+    void Flush() { assert(false); }
+    size_t PutEnd(Ch*) { assert(false); return 0; }
+protected:
+    /**Called when the current chunk is exhausted.
+     * Implementations set begin, src and end to the next chunk and return true, or return false
+     * at the end of the input.
+     */
+    virtual bool refill() { return false; }
+
+    const char *begin;
+    const char *src;
+    const char *end;
+    /**Bytes in the chunks before begin.*/
+    size_t offset;
+private:
+    bool next_chunk()
+    {
+        if (injected)
+        {
+            // End of the injected ":null", back to the real input
+            begin = saved.begin;
+            src = saved.src;
+            end = saved.end;
+            offset = saved.offset;
+            injected = false;
+            if (src != end) return true;
+        }
+        return refill();
+    }
+    /**next_chunk while skipping, copying the rest of the current chunk to capture first.*/
+    bool skip_next_chunk();
+    /**Take a character while skipping, which must not be the end of the input.*/
+    char skip_take();
+    /**Skip a number or literal, starting at src.*/
+    void skip_scalar();
+    /**Skip the rest of a string after the opening quote.*/
+    void skip_string();
+    /**Skip the rest of an escape sequence after the backslash.*/
+    void skip_escape();
+    /**Skip the rest of an array or object after the opening bracket.*/
+    void skip_container(bool object);
+    /**Present text to the parser, then return to the current position.*/
+    void inject(const char *text, size_t len);
+
+    /**Position to return to after the text injected by skip_value.*/
+    struct Position
+    {
+        const char *begin;
+        const char *src;
+        const char *end;
+        size_t offset;
+    };
+    Position saved;
+    bool injected;
+    /**Destination for the text of the value being skipped, and its start in the current chunk.*/
+    std::string *capture;
+    const char *capture_start;
+};
+
+/**ReaderStream reading fixed size chunks through a reusable buffer.*/
+class ReaderBufferedStream : public ReaderStream
+{
+public:
+    explicit ReaderBufferedStream(size_t buffer_size)
+        : buffer(buffer_size ? buffer_size : 1)
+    {}
+protected:
+    /**Read up to len bytes into buffer, returning the number of bytes read, or 0 at the end.*/
+    virtual size_t read(char *buffer, size_t len) = 0;
+
+    virtual bool refill()override
+    {
+        offset += (size_t)(end - begin);
+        size_t len = read(buffer.data(), buffer.size());
+        begin = src = buffer.data();
+        end = begin + len;
+        return len != 0;
+    }
+private:
+    std::vector<char> buffer;
+};
+
+/**ReaderStream over a std::istream.*/
+class ReaderIStream : public ReaderBufferedStream
+{
+public:
+    ReaderIStream(std::istream &is, size_t buffer_size)
+        : ReaderBufferedStream(buffer_size), is(is)
+    {}
+protected:
+    virtual size_t read(char *buffer, size_t len)override
+    {
+        is.read(buffer, (std::streamsize)len);
+        if (is.bad()) throw std::runtime_error("Stream read error");
+        return (size_t)is.gcount();
+    }
+private:
+    std::istream &is;
+};
+
+/**ReaderStream over a file descriptor.*/
+class ReaderFdStream : public ReaderBufferedStream
+{
+public:
+    ReaderFdStream(int fd, size_t buffer_size)
+        : ReaderBufferedStream(buffer_size), fd(fd)
+    {}
+protected:
+    virtual size_t read(char *buffer, size_t len)override;
+private:
+    int fd;
+};
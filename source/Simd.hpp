@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+// SSE2 is part of x86-64, so is always available there. AVX2 kernels are compiled with a target
+// attribute and chosen at runtime, which only GCC and Clang support.
+#if defined(__x86_64__) || defined(_M_X64)
+#   define RAPIDJSON_EXT_SSE2
+#   include <emmintrin.h>
+#   if defined(__GNUC__) && !defined(_WIN32)
+#       define RAPIDJSON_EXT_AVX2
+#       include <immintrin.h>
+#   endif
+#endif
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
+/**Index of the lowest set bit of a non-zero x.*/
+inline unsigned count_trailing_zeros(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(x);
+#endif
+}
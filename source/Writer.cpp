@@ -1,7 +1,18 @@
 #include "Writer.hpp"
+#include "WriterBuffer.hpp"
+#include "JsonEscape.hpp"
+#include "JsonNumbers.hpp"
+#include "WriterCbor.hpp"
+#include "ReaderStream.hpp"
+#include "ReaderHandler.hpp"
+#include <rapidjson/reader.h>
 #include <rapidjson/writer.h>
 #include <stdexcept>
-#include <limits>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <new>
 
 namespace
 {
@@ -9,105 +20,518 @@ namespace
     {
         if (!b) throw std::runtime_error("JsonWriter error");
     }
+
+    /**rapidjson::Writer with string output replaced by write_json_string.*/
+    class ExtWriter : public rapidjson::Writer<WriterBuffer>
+    {
+    public:
+        explicit ExtWriter(WriterBuffer &buffer) : rapidjson::Writer<WriterBuffer>(buffer) {}
+
+        void string(const char *str, size_t len)
+        {
+            Prefix(rapidjson::kStringType);
+            write_json_string(*os_, str, len);
+            end_value();
+        }
+
+        /**Write an already quoted key. The ':' is written by the Prefix of its value.*/
+        void quoted_key(const char *str, size_t len)
+        {
+            Prefix(rapidjson::kStringType);
+            os_->write(str, len);
+        }
+
+        /**Write the elements of a numeric array between the brackets.*/
+        template<class T>
+        void number_array(WriterBuffer &buffer, const T *p, size_t n)
+        {
+            check(StartArray());
+            if constexpr (std::is_same<T, double>::value) write_json_numbers(buffer, p, n, maxDecimalPlaces_);
+            else write_json_numbers(buffer, p, n);
+            check(EndArray());
+        }
+
+        /**Write an already serialized value.*/
+        void raw(const char *json, size_t len)
+        {
+            Prefix(rapidjson::kObjectType);
+            os_->write(json, len);
+            end_value();
+        }
+
+        /**Write an already formatted number.*/
+        void number(const char *str, size_t len)
+        {
+            Prefix(rapidjson::kNumberType);
+            os_->write(str, len);
+            end_value();
+        }
+    private:
+        void end_value()
+        {
+            if (level_stack_.Empty()) os_->Flush();
+        }
+    };
+}
+
+WriterBuffer::WriterBuffer(JsonSink *sink, char *buffer, size_t capacity)
+    : sink(sink), storage(), begin(nullptr), pos(nullptr), end(nullptr)
+{
+    RAPIDJSON_EXT_STATS_ONLY(sunk = counted = 0;)
+    if (buffer && capacity > 1)
+    {
+        // Keep the last byte for the null terminator added by data()
+        begin = pos = buffer;
+        end = begin + capacity - 1;
+    }
+    else
+    {
+        if (capacity == 0) capacity = 1;
+        storage.reset(new char[capacity + 1]);
+        begin = pos = storage.get();
+        end = begin + capacity;
+    }
+}
+
+const char *WriterBuffer::data()
+{
+    *pos = '\0';
+    return begin;
+}
+
+void WriterBuffer::flush_sink()
+{
+    if (pos != begin) sink_write(begin, size());
+    pos = begin;
+    sink->flush();
+}
+
+void WriterBuffer::reserve(size_t n)
+{
+    if (n > capacity()) grow(n);
+}
+
+void WriterBuffer::overflow(size_t n)
+{
+    if (sink)
+    {
+        if (pos != begin) sink_write(begin, size());
+        pos = begin;
+        if ((size_t)(end - pos) >= n) return;
+    }
+    size_t new_capacity = capacity() * 2;
+    if (new_capacity < size() + n) new_capacity = size() + n;
+    grow(new_capacity);
+}
+
+void WriterBuffer::grow(size_t new_capacity)
+{
+    RAPIDJSON_EXT_STATS_ONLY(if (auto stats = JsonStatsScope::current()) ++stats->buffer_grows;)
+    size_t len = size();
+    std::unique_ptr<char[]> new_storage(new char[new_capacity + 1]);
+    std::memcpy(new_storage.get(), begin, len);
+    storage = std::move(new_storage);
+    begin = storage.get();
+    pos = begin + len;
+    end = begin + new_capacity;
+}
+
+void WriterBuffer::write_overflow(const char *data, size_t len)
+{
+    if (sink && len >= (size_t)(end - begin))
+    {
+        // Larger than the buffer, so pass straight through rather than copying it in parts
+        if (pos != begin) sink_write(begin, size());
+        pos = begin;
+        sink_write(data, len);
+        return;
+    }
+    overflow(len);
+    std::memcpy(pos, data, len);
+    pos += len;
 }
+
+#ifdef RAPIDJSON_EXT_STATS
+void WriterBuffer::count_document()
+{
+    uint64_t produced = sunk + size();
+    auto stats = JsonStatsScope::current();
+    if (stats && produced != counted)
+    {
+        ++stats->documents_written;
+        stats->bytes_written += produced - counted;
+    }
+    counted = produced;
+}
+#endif
+
+namespace
+{
+    /**rapidjson SAX handler encoding the parsed value with a CborWriter, for value_raw.*/
+    class CborTranscoder
+    {
+    public:
+        explicit CborTranscoder(CborWriter &out) : out(out) {}
+
+        bool Null() { out.value_null(); return true; }
+        bool Bool(bool b) { out.value_bool(b); return true; }
+        bool Int(int i) { out.value_int64(i); return true; }
+        bool Uint(unsigned i) { out.value_uint64(i); return true; }
+        bool Int64(int64_t i) { out.value_int64(i); return true; }
+        bool Uint64(uint64_t i) { out.value_uint64(i); return true; }
+        bool Double(double d) { out.value_double(d); return true; }
+        bool RawNumber(const char *str, rapidjson::SizeType length, bool copy) { return false; }
+        bool String(const char *str, rapidjson::SizeType length, bool copy)
+        {
+            out.value_string(str, length);
+            return true;
+        }
+        bool Key(const char *str, rapidjson::SizeType length, bool copy)
+        {
+            out.key(str, length);
+            return true;
+        }
+        bool StartObject() { out.start_object(); return true; }
+        bool EndObject(rapidjson::SizeType) { out.end_container(); return true; }
+        bool StartArray() { out.start_array(); return true; }
+        bool EndArray(rapidjson::SizeType) { out.end_container(); return true; }
+    private:
+        CborWriter &out;
+    };
+}
+
 struct JsonWriter::Impl
 {
-    rapidjson::StringBuffer buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> writer;
+    WriterBuffer buffer;
+    ExtWriter writer;
+    CborWriter cbor_writer;
+    JsonEncoding encoding;
 
-    Impl() : buffer(), writer(buffer) {}
+    Impl(JsonSink *sink, char *storage, size_t capacity)
+        : buffer(sink, storage, capacity), writer(buffer), cbor_writer(buffer), encoding(JsonEncoding::json)
+    {}
+
+    bool cbor()const { return encoding == JsonEncoding::cbor; }
 };
 
+namespace
+{
+    /**Write a float formatted by std::to_chars, with room for 2 more chars after end.
+     * Like rapidjson's Double, non-finite values are an error, and if point_zero is set, whole
+     * numbers get a ".0".
+     */
+    template<class Impl>
+    void write_float(Impl &impl, float x, char *begin, char *end, bool point_zero)
+    {
+        check(std::isfinite(x));
+        if (point_zero && std::find_if(begin, end, [](char c) { return c == '.' || c == 'e'; }) == end)
+        {
+            *end++ = '.';
+            *end++ = '0';
+        }
+        impl.writer.number(begin, (size_t)(end - begin));
+    }
+}
+
 JsonWriter::JsonWriter()
-    : impl(new Impl())
+    : impl(new (impl_storage) Impl(nullptr, nullptr, 256))
+{
+    static_assert(sizeof(Impl) <= IMPL_SIZE, "JsonWriter::IMPL_SIZE too small");
+    static_assert(alignof(Impl) <= alignof(std::max_align_t), "JsonWriter::Impl over aligned");
+}
+
+JsonWriter::JsonWriter(JsonSink &sink, size_t buffer_size)
+    : impl(new (impl_storage) Impl(&sink, nullptr, buffer_size))
+{
+}
+
+JsonWriter::JsonWriter(char *buffer, size_t capacity)
+    : impl(new (impl_storage) Impl(nullptr, buffer, capacity))
+{
+}
+
+JsonWriter::JsonWriter(JsonSink &sink, char *buffer, size_t capacity)
+    : impl(new (impl_storage) Impl(&sink, buffer, capacity))
 {
 }
 
 JsonWriter::~JsonWriter()
 {
-    delete impl;
+    impl->~Impl();
 }
 
 const char * JsonWriter::data() const
 {
-    return impl->buffer.GetString();
+    return impl->buffer.data();
 }
 
 size_t JsonWriter::size() const
 {
-    return impl->buffer.GetSize();
+    return impl->buffer.size();
+}
+
+void JsonWriter::flush()
+{
+    impl->buffer.flush();
+}
+
+void JsonWriter::reset()
+{
+    impl->buffer.clear();
+    impl->writer.Reset(impl->buffer);
+    impl->cbor_writer.reset();
+}
+
+void JsonWriter::next_document(char separator)
+{
+    // CBOR values are self delimiting, so a sequence of them needs no separator
+    if (!impl->cbor()) impl->buffer.Put(separator);
+    impl->writer.Reset(impl->buffer);
+    impl->cbor_writer.reset();
+}
+
+void JsonWriter::set_encoding(JsonEncoding encoding)
+{
+    impl->encoding = encoding;
+}
+
+JsonEncoding JsonWriter::encoding()const
+{
+    return impl->encoding;
+}
+
+void JsonWriter::reserve(size_t n)
+{
+    impl->buffer.reserve(n);
+}
+
+size_t JsonWriter::capacity() const
+{
+    return impl->buffer.capacity();
+}
+
+JsonWriterPool::Handle::~Handle()
+{
+    if (writer) pool->release(std::move(writer));
+}
+
+JsonWriterPool::JsonWriterPool(size_t max_writers, size_t max_capacity)
+    : max_writers(max_writers), max_capacity(max_capacity)
+{
+}
+
+JsonWriterPool::Handle JsonWriterPool::acquire()
+{
+    if (writers.empty()) return Handle(this, std::make_unique<JsonWriter>());
+    auto writer = std::move(writers.back());
+    writers.pop_back();
+    // The last borrower may have changed the encoding
+    writer->reset();
+    writer->set_encoding(JsonEncoding::json);
+    return Handle(this, std::move(writer));
+}
+
+void JsonWriterPool::release(std::unique_ptr<JsonWriter> &&writer)
+{
+    if (writers.size() < max_writers && writer->capacity() <= max_capacity)
+        writers.push_back(std::move(writer));
+}
+
+JsonWriterPool &JsonWriterPool::thread_pool()
+{
+    thread_local JsonWriterPool pool;
+    return pool;
 }
 
 void JsonWriter::start_array()
 {
-    check(impl->writer.StartArray());
+    if (impl->cbor()) impl->cbor_writer.start_array();
+    else check(impl->writer.StartArray());
 }
 
 void JsonWriter::end_array()
 {
-    check(impl->writer.EndArray());
+    if (impl->cbor()) impl->cbor_writer.end_container();
+    else check(impl->writer.EndArray());
 }
 
 void JsonWriter::start_object()
 {
-    check(impl->writer.StartObject());
+    if (impl->cbor()) impl->cbor_writer.start_object();
+    else check(impl->writer.StartObject());
 }
 
 void JsonWriter::end_object()
 {
-    check(impl->writer.EndObject());
+    if (impl->cbor()) impl->cbor_writer.end_container();
+    else check(impl->writer.EndObject());
 }
 
 void JsonWriter::key(const char * str, size_t len)
 {
-    if (len > std::numeric_limits<rapidjson::SizeType>::max())
-        throw std::runtime_error("Max string length exceeded");
-    check(impl->writer.Key(str, (rapidjson::SizeType)len, true));
+    if (impl->cbor()) impl->cbor_writer.key(str, len);
+    else impl->writer.string(str, len);
+}
+
+void JsonWriter::key_quoted(const char *quoted, size_t quoted_len, const char *str, size_t len)
+{
+    if (impl->cbor()) impl->cbor_writer.key(str, len);
+    else impl->writer.quoted_key(quoted, quoted_len);
 }
 
 void JsonWriter::value_null()
 {
-    check(impl->writer.Null());
+    if (impl->cbor()) impl->cbor_writer.value_null();
+    else check(impl->writer.Null());
 }
 
 void JsonWriter::value_string(const char * str, size_t len)
 {
-    if (len > std::numeric_limits<rapidjson::SizeType>::max())
-        throw std::runtime_error("Max string length exceeded");
-    check(impl->writer.String(str, (rapidjson::SizeType)len, true));
+    if (impl->cbor()) impl->cbor_writer.value_string(str, len);
+    else impl->writer.string(str, len);
 }
 
 void JsonWriter::value_string(const char * str)
 {
-    check(impl->writer.String(str));
+    if (impl->cbor()) impl->cbor_writer.value_string(str, std::strlen(str));
+    else impl->writer.string(str, std::strlen(str));
 }
 
 void JsonWriter::value_int(int x)
 {
-    check(impl->writer.Int(x));
+    if (impl->cbor()) impl->cbor_writer.value_int64(x);
+    else check(impl->writer.Int(x));
 }
 
 void JsonWriter::value_uint(unsigned x)
 {
-    check(impl->writer.Uint(x));
+    if (impl->cbor()) impl->cbor_writer.value_uint64(x);
+    else check(impl->writer.Uint(x));
 }
 
 void JsonWriter::value_int64(long long x)
 {
-    check(impl->writer.Int64(x));
+    if (impl->cbor()) impl->cbor_writer.value_int64(x);
+    else check(impl->writer.Int64(x));
 }
 
 void JsonWriter::value_uint64(unsigned long long x)
 {
-    check(impl->writer.Uint64(x));
+    if (impl->cbor()) impl->cbor_writer.value_uint64(x);
+    else check(impl->writer.Uint64(x));
 }
 
 void JsonWriter::value_double(double x)
 {
-    check(impl->writer.Double(x));
+    if (impl->cbor())
+    {
+        // Non-finite values are an error, as for JSON
+        check(std::isfinite(x));
+        impl->cbor_writer.value_double(x);
+    }
+    else check(impl->writer.Double(x));
+}
+
+void JsonWriter::value_float(float x)
+{
+    if (impl->cbor())
+    {
+        check(std::isfinite(x));
+        impl->cbor_writer.value_float(x);
+        return;
+    }
+    char buffer[32];
+    auto ret = std::to_chars(buffer, buffer + sizeof(buffer) - 2, x);
+    write_float(*impl, x, buffer, ret.ptr, true);
+}
+
+void JsonWriter::value_float(float x, int precision)
+{
+    // CBOR floats are binary, so always exact
+    if (impl->cbor())
+    {
+        value_float(x);
+        return;
+    }
+    // Up to 39 integer digits, and precision is capped
+    char buffer[96];
+    if (precision < 0) precision = 0;
+    if (precision > 48) precision = 48;
+    auto ret = std::to_chars(buffer, buffer + sizeof(buffer) - 2, x, std::chars_format::fixed, precision);
+    // Exactly precision decimals, so no point at all for 0
+    write_float(*impl, x, buffer, ret.ptr, false);
 }
 
 void JsonWriter::value_bool(bool x)
 {
-    check(impl->writer.Bool(x));
+    if (impl->cbor()) impl->cbor_writer.value_bool(x);
+    else check(impl->writer.Bool(x));
+}
+
+void JsonWriter::value_raw(const char *json, size_t len)
+{
+    // Empty text would leave a separator with no value after it
+    check(std::any_of(json, json + len, [](char c) { return c != ' ' && c != '\n' && c != '\r' && c != '\t'; }));
+    if (impl->cbor())
+    {
+        // Encoding happens during the parse, so check the text first rather than leave part of
+        // the value in the output, or already passed to a sink
+        json_validate(std::string_view(json, len));
+        ReaderStream ss(json, len);
+        CborTranscoder transcoder(impl->cbor_writer);
+        rapidjson::Reader reader;
+        check(!reader.Parse<rapidjson::kParseDefaultFlags>(ss, transcoder).IsError());
+    }
+    else impl->writer.raw(json, len);
+}
+
+void JsonWriter::value_array(const int *p, size_t n)
+{
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
+}
+
+void JsonWriter::value_array(const unsigned *p, size_t n)
+{
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
+}
+
+void JsonWriter::value_array(const long *p, size_t n)
+{
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
+}
+
+void JsonWriter::value_array(const unsigned long *p, size_t n)
+{
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
+}
+
+void JsonWriter::value_array(const long long *p, size_t n)
+{
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
+}
+
+void JsonWriter::value_array(const unsigned long long *p, size_t n)
+{
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
+}
+
+void JsonWriter::value_array(const float *p, size_t n)
+{
+    // One check for the whole array, rather than per element
+    check(std::all_of(p, p + n, [](float x) { return std::isfinite(x); }));
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
+}
+
+void JsonWriter::value_array(const double *p, size_t n)
+{
+    check(std::all_of(p, p + n, [](double x) { return std::isfinite(x); }));
+    if (impl->cbor()) impl->cbor_writer.number_array(p, n);
+    else impl->writer.number_array(impl->buffer, p, n);
 }
@@ -0,0 +1,108 @@
+#pragma once
+#include "JsonSink.hpp"
+#include "JsonStatsHooks.hpp"
+#include <cstring>
+#include <memory>
+
+/**rapidjson output stream for JsonWriter.
+ *
+ * Without a sink this is a growable in-memory buffer. With a sink, the buffer has a fixed
+ * capacity and is passed to the sink whenever it fills, and on Flush, which rapidjson calls
+ * when the top level value is complete.
+ */
+class WriterBuffer
+{
+public:
+    typedef char Ch;
+
+    /**@param buffer Caller owned storage of capacity bytes, or null to allocate it.*/
+    WriterBuffer(JsonSink *sink, char *buffer, size_t capacity);
+
+    WriterBuffer(const WriterBuffer &) = delete;
+    WriterBuffer& operator = (const WriterBuffer &) = delete;
+
+    void Put(Ch c)
+    {
+        if (pos == end) overflow(1);
+        *pos++ = c;
+    }
+    /**Called by rapidjson when the top level value is complete.*/
+    void Flush()
+    {
+        RAPIDJSON_EXT_STATS_ONLY(count_document();)
+        flush();
+    }
+    void flush()
+    {
+        if (sink) flush_sink();
+    }
+
+    /**Append len bytes.*/
+    void write(const char *data, size_t len)
+    {
+        if ((size_t)(end - pos) < len) write_overflow(data, len);
+        else
+        {
+            std::memcpy(pos, data, len);
+            pos += len;
+        }
+    }
+
+    /**Room for at least n bytes to be written directly, ended with commit.*/
+    char *prepare(size_t n)
+    {
+        if ((size_t)(end - pos) < n) overflow(n);
+        return pos;
+    }
+    /**Keep the bytes written from prepare up to p.*/
+    void commit(char *p)
+    {
+        pos = p;
+    }
+
+    /**Unflushed data, null terminated.*/
+    const char *data();
+    size_t size()const { return (size_t)(pos - begin); }
+    size_t capacity()const { return (size_t)(end - begin); }
+    /**Bytes that can be written before the buffer is full.*/
+    size_t available()const { return (size_t)(end - pos); }
+
+    /**Discard the data, keeping the capacity.*/
+    void clear()
+    {
+        pos = begin;
+        RAPIDJSON_EXT_STATS_ONLY(counted = sunk;)
+    }
+    /**Ensure the capacity is at least n bytes.*/
+    void reserve(size_t n);
+
+    /**Pass the buffered data to the sink.*/
+    void flush_sink();
+private:
+    /**Make room for at least n more bytes.*/
+    void overflow(size_t n);
+    void write_overflow(const char *data, size_t len);
+    void grow(size_t new_capacity);
+    /**Pass len bytes from data to the sink.*/
+    void sink_write(const char *data, size_t len)
+    {
+        sink->write(data, len);
+        RAPIDJSON_EXT_STATS_ONLY(sunk += len;)
+    }
+#ifdef RAPIDJSON_EXT_STATS
+    /**Add the output since the last call to the current JsonStats, as a document.*/
+    void count_document();
+
+    /**Bytes passed to the sink.*/
+    uint64_t sunk;
+    /**Output bytes, sunk + size(), already added to JsonStats.*/
+    uint64_t counted;
+#endif
+
+    JsonSink *sink;
+    /**Heap storage, unless using a caller supplied buffer.*/
+    std::unique_ptr<char[]> storage;
+    char *begin;
+    char *pos;
+    char *end;
+};
@@ -0,0 +1,49 @@
+#include "WriterCache.hpp"
+
+JsonFragmentCache::JsonFragmentCache(size_t max_entries)
+    : max_entries(max_entries ? max_entries : 1), mutex(), entries()
+{
+}
+
+std::shared_ptr<const std::string> JsonFragmentCache::find(const void *id, std::type_index type, uint64_t version)const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(Key{ id, type });
+    if (it == entries.end() || it->second.version != version) return nullptr;
+    return it->second.json;
+}
+
+std::shared_ptr<const std::string> JsonFragmentCache::insert(const void *id, std::type_index type, uint64_t version, std::string &&json)
+{
+    auto shared = std::make_shared<const std::string>(std::move(json));
+    Key key{ id, type };
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end())
+    {
+        // Entries for values that no longer exist are never looked up again, so rather than
+        // tracking use, start over when full
+        if (entries.size() >= max_entries) entries.clear();
+        entries.emplace(key, Entry{ version, shared });
+    }
+    else it->second = Entry{ version, shared };
+    return shared;
+}
+
+void JsonFragmentCache::erase(const void *id, std::type_index type)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.erase(Key{ id, type });
+}
+
+void JsonFragmentCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
+
+size_t JsonFragmentCache::size()const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
@@ -0,0 +1,125 @@
+#include "WriterCbor.hpp"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+void CborWriter::start_array()
+{
+    out.Put((char)0x9F);
+    ++depth;
+}
+
+void CborWriter::start_object()
+{
+    out.Put((char)0xBF);
+    ++depth;
+}
+
+void CborWriter::end_container()
+{
+    if (depth == 0) throw std::runtime_error("JsonWriter error");
+    out.Put((char)0xFF);
+    --depth;
+    end_value();
+}
+
+void CborWriter::value_null()
+{
+    out.Put((char)0xF6);
+    end_value();
+}
+
+void CborWriter::value_bool(bool x)
+{
+    out.Put(x ? (char)0xF5 : (char)0xF4);
+    end_value();
+}
+
+void CborWriter::value_int64(long long x)
+{
+    number(x);
+    end_value();
+}
+
+void CborWriter::value_uint64(unsigned long long x)
+{
+    head(0, x);
+    end_value();
+}
+
+void CborWriter::value_float(float x)
+{
+    number(x);
+    end_value();
+}
+
+void CborWriter::value_double(double x)
+{
+    number(x);
+    end_value();
+}
+
+void CborWriter::head(unsigned major, uint64_t n)
+{
+    char buf[9];
+    size_t len;
+    char type = (char)(major << 5);
+    if (n < 24)
+    {
+        buf[0] = (char)(type | (char)n);
+        len = 1;
+    }
+    else
+    {
+        // 1, 2, 4 or 8 bytes of big endian argument, after 24, 25, 26 or 27
+        unsigned log2_bytes = n <= 0xFF ? 0 : n <= 0xFFFF ? 1 : n <= 0xFFFFFFFF ? 2 : 3;
+        size_t bytes = (size_t)1 << log2_bytes;
+        buf[0] = (char)(type | (char)(24 + log2_bytes));
+        for (size_t i = 0; i < bytes; ++i) buf[bytes - i] = (char)(n >> (8 * i));
+        len = bytes + 1;
+    }
+    out.write(buf, len);
+}
+
+void CborWriter::text(const char *str, size_t len)
+{
+    head(3, len);
+    out.write(str, len);
+}
+
+void CborWriter::float_bits(uint32_t bits)
+{
+    char buf[5] = { (char)0xFA, (char)(bits >> 24), (char)(bits >> 16), (char)(bits >> 8), (char)bits };
+    out.write(buf, 5);
+}
+
+void CborWriter::number(long long x)
+{
+    // Negative values are stored as -1 - n
+    if (x < 0) head(1, (uint64_t)-(x + 1));
+    else head(0, (uint64_t)x);
+}
+
+void CborWriter::number(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, 4);
+    float_bits(bits);
+}
+
+void CborWriter::number(double x)
+{
+    // Out of range conversion to float is undefined, so check the range first
+    if (std::fabs(x) <= std::numeric_limits<float>::max() && (double)(float)x == x)
+    {
+        number((float)x);
+        return;
+    }
+    uint64_t bits;
+    std::memcpy(&bits, &x, 8);
+    char buf[9];
+    buf[0] = (char)0xFB;
+    for (size_t i = 0; i < 8; ++i) buf[8 - i] = (char)(bits >> (8 * i));
+    out.write(buf, 9);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "WriterBuffer.hpp"
+#include <cstddef>
+#include <cstdint>
+
+/**CBOR (RFC 8949) encoder for JsonWriter with JsonEncoding::cbor.
+ *
+ * Arrays and objects are written with indefinite lengths, as their sizes are not known up front,
+ * except for the numeric arrays of JsonWriter::value_array. Integers use the smallest encoding
+ * for their value, and doubles that are exactly representable as floats are written as floats.
+ */
+class CborWriter
+{
+public:
+    explicit CborWriter(WriterBuffer &out) : out(out), depth(0) {}
+
+    /**Start a new document.*/
+    void reset() { depth = 0; }
+    /**True if inside an array or object.*/
+    bool nested()const { return depth != 0; }
+
+    void start_array();
+    void start_object();
+    /**End the current array or object.*/
+    void end_container();
+
+    void key(const char *str, size_t len) { text(str, len); }
+    void value_null();
+    void value_bool(bool x);
+    void value_int64(long long x);
+    void value_uint64(unsigned long long x);
+    void value_float(float x);
+    void value_double(double x);
+    void value_string(const char *str, size_t len)
+    {
+        text(str, len);
+        end_value();
+    }
+
+    /**Write a definite length array of numbers.*/
+    template<class T>
+    void number_array(const T *p, size_t n)
+    {
+        head(4, n);
+        for (size_t i = 0; i < n; ++i) number(p[i]);
+        end_value();
+    }
+private:
+    /**Write the initial byte of major type major, and its argument n.*/
+    void head(unsigned major, uint64_t n);
+    void text(const char *str, size_t len);
+    void float_bits(uint32_t bits);
+    void end_value()
+    {
+        if (depth == 0) out.Flush();
+    }
+
+    void number(long long x);
+    void number(unsigned long long x) { head(0, x); }
+    void number(int x) { number((long long)x); }
+    void number(long x) { number((long long)x); }
+    void number(unsigned x) { head(0, x); }
+    void number(unsigned long x) { head(0, x); }
+    void number(float x);
+    void number(double x);
+
+    WriterBuffer &out;
+    /**Number of open arrays and objects.*/
+    size_t depth;
+};
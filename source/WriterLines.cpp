@@ -0,0 +1,99 @@
+#include "WriterLines.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    /**Most values serialized into one worker buffer before passing it to the sink.*/
+    const size_t MAX_BATCH = 1024;
+}
+
+void write_json_lines(
+    size_t count, const std::function<void(JsonWriter &writer, size_t i)> &write_value,
+    JsonSink &sink, JsonLinesFormat format, unsigned threads)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    // A few batches per thread, so that a slow batch does not hold up the rest
+    size_t batch_size = std::min(MAX_BATCH, count / ((size_t)threads * 4) + 1);
+    size_t batches = (count + batch_size - 1) / batch_size;
+
+    bool array = format == JsonLinesFormat::array;
+    if (array) sink.write("[", 1);
+
+    std::mutex mutex;
+    std::condition_variable written_cond;
+    size_t written = 0;
+    bool failed = false;
+    std::exception_ptr error;
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]()
+    {
+        JsonWriter writer;
+        size_t batch;
+        while ((batch = next++) < batches)
+        {
+            bool ok = true;
+            try
+            {
+                size_t begin = batch * batch_size;
+                size_t end = std::min(count, begin + batch_size);
+                writer.reset();
+                for (size_t i = begin; i < end; ++i)
+                {
+                    if (array && i != 0) writer.next_document(',');
+                    write_value(writer, i);
+                    if (!array) writer.next_document('\n');
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                written_cond.wait(lock, [&]() { return written == batch || failed; });
+                if (failed) return;
+                sink.write(writer.data(), writer.size());
+                ++written;
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!failed) error = std::current_exception();
+                failed = true;
+                ok = false;
+            }
+            written_cond.notify_all();
+            if (!ok) return;
+        }
+    };
+
+    size_t worker_count = std::min((size_t)threads, batches);
+    if (worker_count <= 1) worker();
+    else
+    {
+        std::vector<std::thread> workers;
+        workers.reserve(worker_count - 1);
+        try
+        {
+            for (size_t i = 1; i < worker_count; ++i) workers.emplace_back(worker);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = true;
+            }
+            written_cond.notify_all();
+            for (auto &t : workers) t.join();
+            throw;
+        }
+        worker();
+        for (auto &t : workers) t.join();
+    }
+    if (error) std::rethrow_exception(error);
+
+    if (array) sink.write("]", 1);
+    sink.flush();
+}
@@ -1,7 +1,19 @@
 #include <boost/test/unit_test.hpp>
 #include "Reader.hpp"
+#include "ReaderArena.hpp"
+#include "ReaderFields.hpp"
+#include "ReaderLines.hpp"
+#include "ReaderCursor.hpp"
+#include "ReaderPush.hpp"
+#include "ReaderStatic.hpp"
+#include "JsonStats.hpp"
+#include "Writer.hpp"
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 #include <vector>
 #include <list>
 
@@ -24,15 +36,22 @@ class MyObjectReader : public ReaderObject
 public:
     MyObjectReader(MyObject *out) : out(out) {}
 
-    //TODO: Make fields mandatory
-    virtual std::unique_ptr<ReaderFrame> key(const std::string &str)override
+    virtual std::unique_ptr<ReaderFrame> key(std::string_view str)override
     {
         typedef std::vector<std::string> T;
 
-        if (str == "x") return make_json_reader(&out->x);
+        if (str == "x")
+        {
+            mark_seen(0);
+            return make_json_reader(&out->x);
+        }
         else if (str == "str") return make_json_reader(&out->str);
         else if (str == "words") return make_json_reader(&out->words);
-        else throw std::runtime_error("Unknown key " + str);
+        else throw std::runtime_error("Unknown key " + std::string(str));
+    }
+    virtual void end_object()override
+    {
+        check_required(1, { "x" });
     }
 private:
     MyObject *out;
@@ -52,11 +71,11 @@ class MyObjectReader2 : public ReaderObject
 public:
     MyObjectReader2(MyObject2 *out) : out(out) {}
 
-    virtual std::unique_ptr<ReaderFrame> key(const std::string &str)override
+    virtual std::unique_ptr<ReaderFrame> key(std::string_view str)override
     {
         if (str == "a") return make_json_reader(&out->a);
         else if (str == "b") return make_json_reader(&out->b);
-        else throw std::runtime_error("Unknown key " + str);
+        else throw std::runtime_error("Unknown key " + std::string(str));
     }
 private:
     MyObject2 *out;
@@ -66,6 +85,62 @@ inline std::unique_ptr<ReaderFrame> make_json_reader(MyObject2 *p)
     return std::make_unique<MyObjectReader2>(p);
 }
 
+// The same as MyObject, but declared with a field table
+struct MyFieldsObject
+{
+    int x;
+    std::string str;
+    std::vector<std::string> words;
+    MyObject child;
+};
+inline std::unique_ptr<ReaderFrame> make_json_reader(MyFieldsObject *p)
+{
+    static const ReaderFields<MyFieldsObject> fields = {
+        { "x", &MyFieldsObject::x },
+        { "str", &MyFieldsObject::str },
+        { "words", &MyFieldsObject::words },
+        { "child", &MyFieldsObject::child }
+    };
+    return make_json_fields_reader(p, fields);
+}
+
+// Fields with constraints
+struct Server
+{
+    std::string host;
+    int port;
+    double load;
+    std::vector<Server> backups;
+};
+inline std::unique_ptr<ReaderFrame> make_json_reader(Server *p)
+{
+    static const ReaderFields<Server> fields({
+        { "host", &Server::host, json_required() },
+        { "port", &Server::port, json_range(1, 65535).required() },
+        { "load", &Server::load, json_range(0, 1) },
+        { "backups", &Server::backups }
+    }, true);
+    return make_json_fields_reader(p, fields);
+}
+
+// MyObject and MyFieldsObject for read_json_static
+inline void read_json_value(JsonPullReader &reader, MyObject *p)
+{
+    static const auto fields = make_json_static_fields(
+        json_field("x", &MyObject::x),
+        json_field("str", &MyObject::str),
+        json_field("words", &MyObject::words));
+    fields.read(reader, p);
+}
+inline void read_json_value(JsonPullReader &reader, MyFieldsObject *p)
+{
+    static const auto fields = make_json_static_fields_ignore_unknown(
+        json_field("x", &MyFieldsObject::x),
+        json_field("str", &MyFieldsObject::str),
+        json_field("words", &MyFieldsObject::words),
+        json_field("child", &MyFieldsObject::child));
+    fields.read(reader, p);
+}
 
 BOOST_AUTO_TEST_CASE(object)
 {
@@ -125,4 +200,740 @@ BOOST_AUTO_TEST_CASE(array_nested)
     std::vector<std::vector<int>> arrays;
     read_json(quotes(json), &arrays);
 }
+BOOST_AUTO_TEST_CASE(inputs)
+{
+    std::string json = quotes("{'x':55,'str':'Hello World','words':['Apple','Orange']}");
+    std::string expected_words[] = { "Apple", "Orange" };
+    auto check = [&](const MyObject &a)
+    {
+        BOOST_CHECK_EQUAL(55, a.x);
+        BOOST_CHECK_EQUAL("Hello World", a.str);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected_words, expected_words + 2, a.words.begin(), a.words.end());
+    };
+
+    MyObject a;
+    read_json(json.data(), json.size(), &a);
+    check(a);
+
+    // Small buffer, so tokens span several reads
+    MyObject b;
+    std::istringstream ss(json);
+    read_json(ss, &b, 3);
+    check(b);
+
+    MyObject c;
+    std::string path = "rapidjson-ext-ut-inputs.json";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << json;
+    }
+    read_json_file(path, &c);
+    std::remove(path.c_str());
+    check(c);
+
+    MyObject d;
+    BOOST_CHECK_THROW(read_json_file("rapidjson-ext-ut-missing.json", &d), std::runtime_error);
+}
+BOOST_AUTO_TEST_CASE(arena)
+{
+    int x, y;
+    ReaderArena arena;
+    {
+        ReaderArena::Scope scope(arena);
+        auto a = ::make_json_reader(&x);
+        auto b = ::make_json_reader(&y);
+        void *first = a.get(), *last = b.get();
+        // Freeing the most recent frame allows its memory to be reused straight away
+        b.reset();
+        b = ::make_json_reader(&x);
+        BOOST_CHECK_EQUAL(last, (void*)b.get());
+        // Out of order frees are reclaimed once all the frames are gone
+        a.reset();
+        b.reset();
+        auto c = ::make_json_reader(&y);
+        BOOST_CHECK_EQUAL(first, (void*)c.get());
+    }
+    // Outside of a scope frames are on the heap
+    BOOST_CHECK(!ReaderArena::current());
+    auto heap_frame = ::make_json_reader(&x);
+    heap_frame.reset();
+
+    std::vector<MyObject> objects;
+    std::string json = "[";
+    for (int i = 0; i < 1000; ++i) json += (i ? "," : "") + quotes("{'x':" + std::to_string(i) + ",'words':['a','b']}");
+    json += "]";
+    read_json(json, &objects);
+    BOOST_REQUIRE_EQUAL(1000, objects.size());
+    BOOST_CHECK_EQUAL(999, objects[999].x);
+    BOOST_CHECK_EQUAL("b", objects[999].words[1]);
+}
+BOOST_AUTO_TEST_CASE(object_fields)
+{
+    MyFieldsObject a;
+    std::string json =
+        "{'str':'Hello World','x':55,'words':['Apple','Orange'],'child':{'x':10,'str':'Red'}}"
+        ;
+    std::string expected_words[] = { "Apple", "Orange" };
+
+    read_json(quotes(json), &a);
+    BOOST_CHECK_EQUAL(55, a.x);
+    BOOST_CHECK_EQUAL("Hello World", a.str);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_words, expected_words + 2, a.words.begin(), a.words.end());
+    BOOST_CHECK_EQUAL(10, a.child.x);
+    BOOST_CHECK_EQUAL("Red", a.child.str);
+
+    // Same length, first and last characters as a real key
+    BOOST_CHECK_THROW(read_json(quotes("{'sxr':'a'}"), &a), ReaderError);
+    BOOST_CHECK_THROW(read_json(quotes("{'':1}"), &a), ReaderError);
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 64; ++i) names.push_back("field" + std::to_string(i));
+    std::vector<std::pair<const char*, size_t>> keys;
+    for (auto &name : names) keys.emplace_back(name.data(), name.size());
+    ReaderKeyTable table;
+    table.build(keys);
+    for (size_t i = 0; i < names.size(); ++i) BOOST_CHECK_EQUAL(i, table.find(names[i].data(), names[i].size()));
+    BOOST_CHECK_EQUAL(ReaderKeyTable::npos, table.find("field64", 7));
+    BOOST_CHECK_EQUAL(ReaderKeyTable::npos, table.find("field", 5));
+
+    keys.push_back(keys[0]);
+    BOOST_CHECK_THROW(table.build(keys), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(object_fields_ignore_unknown)
+{
+    struct Point { int x, y; } p = {};
+    static const ReaderFields<Point> fields({ { "x", &Point::x }, { "y", &Point::y } }, true);
+    read_json(quotes("{'x':1,'z':{'a':[1,{'b':2}]},'w':[{'c':[3]}],'y':2}"), make_json_fields_reader(&p, fields));
+    BOOST_CHECK_EQUAL(1, p.x);
+    BOOST_CHECK_EQUAL(2, p.y);
+}
+
+BOOST_AUTO_TEST_CASE(object_fields_required)
+{
+    Server s = {};
+    read_json(quotes("{'port':80,'x':1,'host':'a','load':0.5,'backups':[{'host':'b','port':81}]}"), &s);
+    BOOST_CHECK_EQUAL("a", s.host);
+    BOOST_CHECK_EQUAL(80, s.port);
+    BOOST_CHECK_EQUAL(0.5, s.load);
+    BOOST_REQUIRE_EQUAL(1u, s.backups.size());
+    BOOST_CHECK_EQUAL(81, s.backups[0].port);
+
+    auto error = [](const std::string &json)
+    {
+        Server t = {};
+        try
+        {
+            read_json(quotes(json), &t);
+        }
+        catch (const ReaderError &e)
+        {
+            return std::string(e.what());
+        }
+        return std::string();
+    };
+    BOOST_CHECK_EQUAL("Missing key port", error("{'host':'a'}"));
+    BOOST_CHECK_EQUAL("Missing key host", error("{'port':1,'load':1}"));
+    BOOST_CHECK_EQUAL("Missing key host", error("{'host':'a','port':1,'backups':[{'host':'b','port':1},{'port':2}]}"));
+    BOOST_CHECK_EQUAL("Out of range", error("{'port':0,'host':'a'}"));
+    BOOST_CHECK_EQUAL("Out of range", error("{'host':'a','port':65536}"));
+    BOOST_CHECK_EQUAL("Out of range", error("{'host':'a','port':1,'load':1.5}"));
+    BOOST_CHECK_EQUAL("Out of range", error("{'host':'a','port':1,'load':-1}"));
+    BOOST_CHECK_EQUAL("Unexpected string", error("{'host':'a','port':'1'}"));
+
+    BOOST_CHECK_THROW(ReaderFields<Server>({ { "host", &Server::host, json_range(0, 1) } }), std::invalid_argument);
+
+    // 64 bit integers are compared exactly, not rounded to double
+    struct Big { unsigned long long id; } big = {};
+    static const ReaderFields<Big> big_fields({ { "id", &Big::id, json_range(0, 9007199254740992.0) } });
+    read_json(quotes("{'id':9007199254740992}"), make_json_fields_reader(&big, big_fields));
+    BOOST_CHECK_EQUAL(9007199254740992ull, big.id);
+    BOOST_CHECK_THROW(read_json(quotes("{'id':9007199254740993}"), make_json_fields_reader(&big, big_fields)), ReaderError);
+    BOOST_CHECK_THROW(ReaderFields<Big>({ { "id", &Big::id, json_range(0.5, 1) } }), std::invalid_argument);
+    BOOST_CHECK_THROW(ReaderFields<Big>({ { "id", &Big::id, json_range(-1, 1) } }), std::invalid_argument);
+
+    // Hand written ReaderObject readers track their own required keys
+    MyObject a;
+    read_json(quotes("{'x':1}"), &a);
+    try
+    {
+        read_json(quotes("{'str':'a','words':[]}"), &a);
+        BOOST_ERROR("Expected missing key");
+    }
+    catch (const ReaderError &e)
+    {
+        BOOST_CHECK_EQUAL("Missing key x", std::string(e.what()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(skip)
+{
+    struct Point { int x, y; };
+    static const ReaderFields<Point> fields({ { "x", &Point::x }, { "y", &Point::y } }, true);
+    std::string json = quotes(
+        "{'a' : 'str\\\\','x':1,'s':'}]\\'[{\\u00e9','z':{'a':[1,{'b':'}'}],'c':'\\'\\''},"
+        "'n':-1.5e10 ,'t':true,'w' :[ {'c':[3]} ] ,'y':2,'e':{},'f':[]}");
+
+    Point p = {};
+    read_json(json, make_json_fields_reader(&p, fields));
+    BOOST_CHECK_EQUAL(1, p.x);
+    BOOST_CHECK_EQUAL(2, p.y);
+
+    // Skipping across buffer refills
+    for (size_t buffer_size : { 1, 2, 3, 5, 16, 17 })
+    {
+        Point q = {};
+        std::istringstream ss(json);
+        read_json(ss, make_json_fields_reader(&q, fields), buffer_size);
+        BOOST_CHECK_EQUAL(1, q.x);
+        BOOST_CHECK_EQUAL(2, q.y);
+    }
+
+    // In-situ parsing can not skip, so parses the value into a ReaderDiscard
+    Point r = {};
+    std::string insitu = json;
+    read_json_insitu(insitu, make_json_fields_reader(&r, fields));
+    BOOST_CHECK_EQUAL(2, r.y);
+
+    // Skipped values are checked as strictly as parsed ones, whichever way the input is read
+    const char *malformed[] = {
+        "{'a':'x", "{'a':[{]", "{'a':}", "{'junk':[1},'x':3}", "{'a':{'b':1]}",
+        "{'a':tru}", "{'a':nul}", "{'a':1.2.3}", "{'a':--5}", "{'a':01}", "{'a':1.}",
+        "{'a':[1 2]}", "{'a':[1,]}", "{'a':{'b'}}", "{'a':{1:2}}",
+        "{'a':'\\q'}", "{'a':'\\u12g4'}", "{'a':'\\ud800'}", "{'a':'\t'}"
+    };
+    for (auto bad : malformed)
+    {
+        std::string text = quotes(bad);
+        Point t = {};
+        BOOST_CHECK_THROW(read_json(text, make_json_fields_reader(&t, fields)), std::runtime_error);
+        std::istringstream ss(text);
+        BOOST_CHECK_THROW(read_json(ss, make_json_fields_reader(&t, fields), 2), std::runtime_error);
+        std::string copy = text;
+        BOOST_CHECK_THROW(read_json_insitu(copy, make_json_fields_reader(&t, fields)), std::runtime_error);
+        JsonPushReader push(make_json_fields_reader(&t, fields));
+        BOOST_CHECK_THROW({ push.feed(text.data(), text.size()); push.finish(); }, std::runtime_error);
+        MyFieldsObject s;
+        BOOST_CHECK_THROW(read_json_static(text, &s), std::runtime_error);
+    }
+}
+BOOST_AUTO_TEST_CASE(insitu)
+{
+    MyObject a;
+    std::string json = quotes("{'x':55,'str':'Hello \\'World\\'','words':['Apple','Orange']}");
+    std::string expected_words[] = { "Apple", "Orange" };
+
+    read_json_insitu(json, &a);
+    BOOST_CHECK_EQUAL(55, a.x);
+    BOOST_CHECK_EQUAL(quotes("Hello 'World'"), a.str);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_words, expected_words + 2, a.words.begin(), a.words.end());
+}
+BOOST_AUTO_TEST_CASE(lines)
+{
+    // Enough lines to be split into several chunks
+    const int count = 50000;
+    std::string json;
+    for (int i = 0; i < count; ++i)
+    {
+        json += quotes("{'x':" + std::to_string(i) + ",'str':'Line " + std::to_string(i) + "','words':['a']}");
+        json += i % 100 == 0 ? "\r\n\n" : "\n";
+    }
+
+    std::vector<MyObject> out;
+    read_json_lines(json, out, 4);
+    BOOST_REQUIRE_EQUAL(count, out.size());
+    bool ordered = true;
+    for (int i = 0; i < count; ++i)
+    {
+        ordered = ordered && out[i].x == i && out[i].str == "Line " + std::to_string(i);
+    }
+    BOOST_CHECK(ordered);
+
+    std::atomic<long long> sum(0);
+    std::atomic<int> docs(0);
+    read_json_lines_unordered<MyObject>(json, [&](MyObject &&a) { sum += a.x; ++docs; }, 4);
+    BOOST_CHECK_EQUAL(count, docs.load());
+    BOOST_CHECK_EQUAL((long long)count * (count - 1) / 2, sum.load());
+
+    // Single threaded, and no trailing newline
+    std::vector<int> ints;
+    read_json_lines("1\n\n  2 \n3", ints, 1);
+    BOOST_CHECK_EQUAL(3, ints.size());
+    BOOST_CHECK_EQUAL(3, ints.back());
+
+    std::vector<int> bad;
+    BOOST_CHECK_THROW(read_json_lines("1 2\n", bad), ReaderError);
+    std::string broken = json + "{'x':\n" + json;
+    BOOST_CHECK_THROW(read_json_lines(broken, out, 4), std::runtime_error);
+
+    // A document may not continue onto the next line, whether or not a chunk ends there
+    for (unsigned threads : { 1u, 4u })
+    {
+        std::vector<MyObject> multi;
+        BOOST_CHECK_THROW(read_json_lines(quotes("{'x':\n1}\n"), multi, threads), std::runtime_error);
+        BOOST_CHECK_THROW(read_json_lines(json + quotes("{'x':\n1}\n") + json, multi, threads), std::runtime_error);
+    }
+}
+BOOST_AUTO_TEST_CASE(array_parallel)
+{
+    // Enough elements to be split into several chunks, with brackets, commas and escaped quotes
+    // in strings to mislead a naive split
+    const int count = 50000;
+    std::string json = "[";
+    for (int i = 0; i < count; ++i)
+    {
+        if (i) json += i % 7 == 0 ? " ,\n" : ",";
+        json += quotes("{'x':" + std::to_string(i) + ",'str':'Item " + std::to_string(i) + "','words':['],[{\\\\','\\'x']}");
+    }
+    json += "] ";
+
+    std::vector<MyObject> expected, out;
+    read_json(json, &expected);
+    read_json_array_parallel(json, out, 4);
+    BOOST_REQUIRE_EQUAL(count, out.size());
+    bool same = true;
+    for (int i = 0; i < count; ++i)
+    {
+        same = same && out[i].x == i && out[i].str == expected[i].str && out[i].words == expected[i].words;
+    }
+    BOOST_CHECK(same);
+    BOOST_CHECK_EQUAL("\"x", out[5].words[1]);
+
+    // Small arrays, in a single chunk
+    std::vector<int> ints;
+    read_json_array_parallel(" [ 1,2 , 3 ]", ints, 1);
+    BOOST_CHECK(std::vector<int>({ 1, 2, 3 }) == ints);
+    ints.clear();
+    read_json_array_parallel("[ ]", ints);
+    BOOST_CHECK(ints.empty());
+
+    for (const char *bad : { "", "{}", "[1,]", "[,1]", "[1 2]", "[1]]", "[1", "['a]", "[[1]", "[1] 2" })
+    {
+        ints.clear();
+        BOOST_CHECK_THROW(read_json_array_parallel(quotes(bad), ints, 2), std::runtime_error);
+        BOOST_CHECK(ints.empty());
+    }
+    std::string broken = json;
+    broken.replace(broken.find(",\"str\"", broken.size() / 2), 1, "}");
+    BOOST_CHECK_THROW(read_json_array_parallel(broken, out, 4), std::runtime_error);
+    std::string trailing = json.substr(0, json.size() - 2) + ", ]";
+    BOOST_CHECK_THROW(read_json_array_parallel(trailing, out, 4), std::runtime_error);
+    BOOST_CHECK_EQUAL(count, out.size());
+}
+BOOST_AUTO_TEST_CASE(push)
+{
+    std::string long_str(5000, 'z');
+    long_str.replace(1234, 2, "\\\\");
+    std::string json = quotes(
+        "{'a':{'x':55,'str':'Hello \\'World\\'','words':['Apple','Orange']},"
+        " 'b' : { 'x' : -12345 , 'str' : '" + long_str + "' , 'words' : [ ] } }");
+
+    for (size_t fragment : { (size_t)1, (size_t)2, (size_t)7, (size_t)100, json.size() })
+    {
+        MyObject2 a;
+        JsonPushReader reader(&a);
+        for (size_t i = 0; i < json.size(); i += fragment)
+        {
+            BOOST_CHECK(!reader.done());
+            reader.feed(json.data() + i, std::min(fragment, json.size() - i));
+        }
+        BOOST_CHECK(reader.done());
+        reader.feed(" \n", 2);
+        reader.finish();
+        BOOST_CHECK_EQUAL(55, a.a.x);
+        BOOST_CHECK_EQUAL(quotes("Hello 'World'"), a.a.str);
+        BOOST_CHECK_EQUAL(2, a.a.words.size());
+        BOOST_CHECK_EQUAL(-12345, a.b.x);
+        BOOST_CHECK_EQUAL(std::string(long_str).erase(1234, 1), a.b.str);
+    }
+
+    // A number is only known to be complete at the end of the input
+    int x = 0;
+    JsonPushReader number_reader(&x);
+    number_reader.feed("12", 2);
+    number_reader.feed("34", 2);
+    BOOST_CHECK(!number_reader.done());
+    number_reader.finish();
+    BOOST_CHECK_EQUAL(1234, x);
+
+    MyObject b;
+    JsonPushReader truncated(&b);
+    truncated.feed("{\"x\":1", 6);
+    BOOST_CHECK_THROW(truncated.finish(), std::runtime_error);
+
+    JsonPushReader trailing(&x);
+    BOOST_CHECK_THROW(trailing.feed("1 2", 3), std::runtime_error);
+}
+BOOST_AUTO_TEST_CASE(cursor)
+{
+    std::string json = "[";
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (i) json += ",";
+        json += quotes("{'x':" + std::to_string(i) + ",'str':'Item " + std::to_string(i) + "'}");
+    }
+    json += "]";
+
+    int count = 0;
+    bool ok = true;
+    JsonArrayCursor<MyObject> cursor(json);
+    for (auto &a : cursor)
+    {
+        // The slot is cleared between elements
+        ok = ok && a.x == count && a.str == "Item " + std::to_string(count) && a.words.empty();
+        a.words.push_back("Dirty");
+        ++count;
+    }
+    BOOST_CHECK(ok);
+    BOOST_CHECK_EQUAL(1000, count);
+    BOOST_CHECK(!cursor.next());
+
+    std::istringstream ss(" [1, 2 ,[3,4], 5 ] ");
+    JsonArrayCursor<std::vector<int>> lists(ss, 4);
+    BOOST_CHECK_THROW(lists.next(), std::runtime_error);
+
+    std::istringstream ints_ss(" [1, 2 ,3, -4 ] ");
+    JsonArrayCursor<int> ints(ints_ss, 3);
+    std::vector<int> values;
+    while (ints.next()) values.push_back(ints.value());
+    BOOST_CHECK_EQUAL(4, values.size());
+    BOOST_CHECK_EQUAL(-4, values.back());
+
+    JsonArrayCursor<int> empty("[]", 2);
+    BOOST_CHECK(!empty.next());
+
+    JsonArrayCursor<int> not_array("{}", 2);
+    BOOST_CHECK_THROW(not_array.next(), ReaderError);
+
+    JsonArrayCursor<int> truncated("[1,2", 4);
+    BOOST_CHECK(truncated.next());
+    BOOST_CHECK(truncated.next());
+    BOOST_CHECK_THROW(truncated.next(), std::runtime_error);
+}
+BOOST_AUTO_TEST_CASE(stats)
+{
+    std::string json = quotes("{'x':55,'str':'Hello World','words':['Apple','Orange']}");
+    JsonStats stats;
+    {
+        JsonStatsScope scope(stats);
+        BOOST_CHECK_EQUAL(&stats, JsonStatsScope::current());
+        MyObject a;
+        read_json(json, &a);
+
+        std::string lines;
+        for (int i = 0; i < 20000; ++i) lines += json + "\n";
+        std::vector<MyObject> out;
+        read_json_lines(lines, out, 4);
+    }
+    BOOST_CHECK(!JsonStatsScope::current());
+#ifdef RAPIDJSON_EXT_STATS
+    // The stats build, see tests/Makefile, must reach the checks below
+    BOOST_REQUIRE(json_stats_enabled());
+#endif
+    if (!json_stats_enabled())
+    {
+        BOOST_CHECK_EQUAL(0, stats.documents_read);
+        BOOST_CHECK_EQUAL(0, stats.frames);
+        return;
+    }
+    BOOST_CHECK_EQUAL(20001, stats.documents_read);
+    BOOST_CHECK_EQUAL(20001 * json.size(), stats.bytes_read);
+    BOOST_CHECK_EQUAL(2, stats.max_depth);
+    // Keys "x", "str" and "words", and the three strings
+    BOOST_CHECK_EQUAL(20001 * 31, stats.string_bytes);
+    BOOST_CHECK(stats.frames >= 20001 * 4);
+    BOOST_CHECK(stats.callback_ns <= stats.parse_ns);
+}
+BOOST_AUTO_TEST_CASE(static_reader)
+{
+    MyFieldsObject a;
+    std::string json = quotes(
+        "{'str':'Hello World','x':55,'skip':{'a':[1,{'b':2}]},'words':['Apple','Orange'],"
+        "'child':{'x':-10,'str':'Red','words':[]},'n':null}");
+    std::string expected_words[] = { "Apple", "Orange" };
+
+    read_json_static(json, &a);
+    BOOST_CHECK_EQUAL(55, a.x);
+    BOOST_CHECK_EQUAL("Hello World", a.str);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_words, expected_words + 2, a.words.begin(), a.words.end());
+    BOOST_CHECK_EQUAL(-10, a.child.x);
+    BOOST_CHECK_EQUAL("Red", a.child.str);
+
+    MyFieldsObject b;
+    std::istringstream is(json);
+    read_json_static(is, &b, 7);
+    BOOST_CHECK_EQUAL(55, b.x);
+    BOOST_CHECK_EQUAL(-10, b.child.x);
+
+    std::vector<std::vector<double>> nested;
+    read_json_static("[[1,-2,3.5],[],[1e3]]", &nested);
+    BOOST_REQUIRE_EQUAL(3, nested.size());
+    BOOST_CHECK_EQUAL(3, nested[0].size());
+    BOOST_CHECK_EQUAL(-2, nested[0][1]);
+    BOOST_CHECK_EQUAL(1000, nested[2][0]);
+
+    unsigned char c;
+    BOOST_CHECK_THROW(read_json_static("256", &c), ReaderError);
+    BOOST_CHECK_THROW(read_json_static("-1", &c), ReaderError);
+    BOOST_CHECK_THROW(read_json_static("'x'", &c), std::runtime_error);
+    BOOST_CHECK_THROW(read_json_static(quotes("'x'"), &c), ReaderError);
+    MyObject strict;
+    BOOST_CHECK_THROW(read_json_static(quotes("{'x':1,'y':2}"), &strict), ReaderError);
+    BOOST_CHECK_THROW(read_json_static(quotes("{'x':'1'}"), &strict), ReaderError);
+    BOOST_CHECK_THROW(read_json_static(quotes("{'x':1} 2"), &strict), std::runtime_error);
+    BOOST_CHECK_THROW(read_json_static(quotes("{'x':1"), &strict), std::runtime_error);
+    BOOST_CHECK_THROW(read_json_static(quotes("[{'x':1}]"), &strict), ReaderError);
+
+    // Tokens
+    std::string tokens = quotes("{'k':[true,null,-1,2]}");
+    JsonPullReader reader(tokens.data(), tokens.size());
+    BOOST_CHECK(reader.next() == JsonPullReader::Token::start_object);
+    BOOST_CHECK(reader.next() == JsonPullReader::Token::key);
+    BOOST_CHECK_EQUAL("k", reader.string());
+    BOOST_CHECK(reader.next() == JsonPullReader::Token::start_array);
+    reader.skip_value();
+    BOOST_CHECK(reader.token() == JsonPullReader::Token::end_array);
+    BOOST_CHECK(reader.next() == JsonPullReader::Token::end_object);
+    reader.finish();
+    BOOST_CHECK_THROW(reader.next(), std::runtime_error);
+}
+BOOST_AUTO_TEST_CASE(size_hint)
+{
+    std::string json = "[";
+    for (int i = 0; i < 1000; ++i) json += (i ? "," : "") + std::to_string(i);
+    json += "]";
+
+    ReaderSizeHint hint;
+    std::vector<int> a, b;
+    read_json(json, make_json_reader(&a, &hint));
+    BOOST_CHECK_EQUAL(1000, hint.get());
+    read_json(json, make_json_reader(&b, &hint));
+    BOOST_CHECK_EQUAL(1000, b.size());
+    BOOST_CHECK_EQUAL(1000, b.capacity());
+
+    // Shorter arrays reduce the hint gradually
+    hint.update(200);
+    BOOST_CHECK_EQUAL(800, hint.get());
+    hint.update(2000);
+    BOOST_CHECK_EQUAL(2000, hint.get());
+
+    // ReaderFields and ReaderStaticFields learn the length of each list field
+    std::string words;
+    for (int i = 0; i < 100; ++i) words += (i ? ",'w" : "'w") + std::to_string(i) + "'";
+    std::string obj = quotes("{'x':1,'words':[" + words + "]}");
+    for (int i = 0; i < 2; ++i)
+    {
+        MyFieldsObject c, d;
+        read_json(obj, &c);
+        read_json_static(obj, &d);
+        BOOST_CHECK_EQUAL(100, c.words.size());
+        BOOST_CHECK_EQUAL(100, d.words.size());
+        if (i == 1)
+        {
+            BOOST_CHECK_EQUAL(100, c.words.capacity());
+            BOOST_CHECK_EQUAL(100, d.words.capacity());
+        }
+    }
+}
+BOOST_AUTO_TEST_CASE(numeric_arrays)
+{
+    // Runs of simple numbers mixed with forms left to rapidjson
+    std::string json = "[ 1, -2,3 ,\n40000000000000000 , 0, -0, 12345678901234567890, 7 ]";
+    std::vector<double> expected = { 1, -2, 3, 4e16, 0, -0.0, 12345678901234567890.0, 7 };
+    std::vector<double> d;
+    read_json(json, &d);
+    BOOST_CHECK(expected == d);
+    std::vector<int64_t> i;
+    read_json("[1,-2,3,40000000000000000,0,-0,9223372036854775807,7]", &i);
+    BOOST_CHECK_EQUAL(8, i.size());
+    BOOST_CHECK_EQUAL(40000000000000000ll, i[3]);
+    BOOST_CHECK_EQUAL(9223372036854775807ll, i[6]);
+    std::vector<uint64_t> u;
+    read_json("[18446744073709551615,9999999999999999999]", &u);
+    BOOST_CHECK(std::vector<uint64_t>({ 18446744073709551615ull, 9999999999999999999ull }) == u);
+    i.clear();
+    read_json("[-9223372036854775808]", &i);
+    BOOST_CHECK_EQUAL(std::numeric_limits<int64_t>::min(), i[0]);
+    i.clear();
+    BOOST_CHECK_THROW(read_json("[9223372036854775808]", &i), ReaderError);
+
+    d.clear();
+    read_json("[0.1,2.5e-3,1e22,-1.25E+2,123456789012345.6,1]", &d);
+    BOOST_CHECK(std::vector<double>({ 0.1, 2.5e-3, 1e22, -125, 123456789012345.6, 1 }) == d);
+
+    // Errors are the same as without the fast path
+    std::vector<int> ints;
+    BOOST_CHECK_THROW(read_json("[1,2.5]", &ints), ReaderError);
+    std::vector<unsigned char> bytes;
+    BOOST_CHECK_THROW(read_json("[1,256]", &bytes), ReaderError);
+    BOOST_CHECK_THROW(read_json("[1,-1]", &bytes), ReaderError);
+    ints.clear();
+    BOOST_CHECK_THROW(read_json("[1,2,]", &ints), std::runtime_error);
+    ints.clear();
+    BOOST_CHECK_THROW(read_json("[1 2]", &ints), std::runtime_error);
+
+    // Long arrays, split across stream buffers, and inside other values
+    std::string big = "[";
+    std::vector<int> big_expected;
+    for (int n = 0; n < 5000; ++n)
+    {
+        int v = n * 7919 - 1000000;
+        big += (n ? "," : "") + std::to_string(v);
+        big_expected.push_back(v);
+    }
+    big += "]";
+    ints.clear();
+    read_json(big, &ints);
+    BOOST_CHECK(big_expected == ints);
+    for (size_t buffer_size : { 3, 7, 64 })
+    {
+        std::istringstream ss(big);
+        ints.clear();
+        read_json(ss, &ints, buffer_size);
+        BOOST_CHECK(big_expected == ints);
+    }
+    std::vector<std::vector<int>> nested;
+    read_json("[[1,2],[],[3],[4,5,6]]", &nested);
+    BOOST_CHECK(std::vector<std::vector<int>>({ { 1, 2 }, {}, { 3 }, { 4, 5, 6 } }) == nested);
+
+    // Static path
+    ints.clear();
+    read_json_static(big, &ints);
+    BOOST_CHECK(big_expected == ints);
+    std::istringstream ss(big);
+    ints.clear();
+    read_json_static(ss, &ints, 5);
+    BOOST_CHECK(big_expected == ints);
+    d.clear();
+    read_json_static(json, &d);
+    BOOST_CHECK(expected == d);
+    nested.clear();
+    read_json_static("[[1,2],[],[3],[4,5,6]]", &nested);
+    BOOST_CHECK_EQUAL(4, nested.size());
+    BOOST_CHECK_EQUAL(3, nested[3].size());
+    bytes.clear();
+    BOOST_CHECK_THROW(read_json_static("[1,256]", &bytes), ReaderError);
+}
+BOOST_AUTO_TEST_CASE(cbor)
+{
+    // Written by JsonWriter, with indefinite length containers
+    JsonWriter writer;
+    writer.set_encoding(JsonEncoding::cbor);
+    writer.start_object();
+    writer.prop("x", -5);
+    writer.prop("unknown", std::vector<std::string>({ "skipped" }));
+    writer.prop("str", std::string("Hello"));
+    writer.prop("words", std::vector<std::string>({ "a", "b" }));
+    writer.key("child");
+    writer.start_object();
+    writer.prop("x", 7);
+    writer.prop("str", std::string());
+    writer.prop("words", std::vector<std::string>());
+    writer.end_object();
+    writer.end_object();
+    MyFieldsObject a;
+    BOOST_CHECK_THROW(read_cbor(writer.data(), writer.size(), &a), ReaderError);
+
+    static const ReaderFields<MyFieldsObject> fields({
+        { "x", &MyFieldsObject::x },
+        { "str", &MyFieldsObject::str },
+        { "words", &MyFieldsObject::words },
+        { "child", &MyFieldsObject::child }
+    }, true);
+    read_cbor(writer.data(), writer.size(), make_json_fields_reader(&a, fields));
+    BOOST_CHECK_EQUAL(-5, a.x);
+    BOOST_CHECK_EQUAL("Hello", a.str);
+    BOOST_CHECK(std::vector<std::string>({ "a", "b" }) == a.words);
+    BOOST_CHECK_EQUAL(7, a.child.x);
+
+    // Numbers, including bulk arrays
+    std::vector<double> doubles = { 0, -1.5, 0.1, 1e300 }, doubles_out;
+    writer.reset();
+    writer.value(doubles);
+    read_cbor(writer.data(), writer.size(), &doubles_out);
+    BOOST_CHECK(doubles == doubles_out);
+    std::vector<long long> ints = { 0, -1, 24, -25, 9223372036854775807ll, -9223372036854775807ll - 1 }, ints_out;
+    writer.reset();
+    writer.value(ints);
+    read_cbor(std::string(writer.data(), writer.size()), &ints_out);
+    BOOST_CHECK(ints == ints_out);
+
+    // Definite lengths, tags, an indefinite length string and half floats
+    std::string bytes("\xA2\x61x\x03\x63str\xC0\x7F\x62He\x63llo\xFF", 18);
+    MyObject b;
+    read_cbor(bytes, &b);
+    BOOST_CHECK_EQUAL(3, b.x);
+    BOOST_CHECK_EQUAL("Hello", b.str);
+    std::vector<double> halves;
+    read_cbor(std::string("\x83\xF9\x3C\x00\xF9\xC4\x00\xF9\x00\x01", 10), &halves);
+    BOOST_CHECK(std::vector<double>({ 1, -4, 5.960464477539063e-8 }) == halves);
+
+    // Malformed input
+    std::vector<int> v;
+    BOOST_CHECK_THROW(read_cbor(std::string(""), &v), std::runtime_error);
+    BOOST_CHECK_THROW(read_cbor(std::string("\x82\x01", 2), &v), std::runtime_error);
+    v.clear();
+    BOOST_CHECK_THROW(read_cbor(std::string("\x81\x01\x01", 3), &v), std::runtime_error);
+    v.clear();
+    BOOST_CHECK_THROW(read_cbor(std::string("\x81\x41\x01", 3), &v), std::runtime_error);
+    BOOST_CHECK_THROW(read_cbor(std::string("\xBF\x61x\xFF", 4), &b), std::runtime_error);
+    BOOST_CHECK_THROW(read_cbor(std::string("\x1C", 1), &b), std::runtime_error);
+}
+BOOST_AUTO_TEST_CASE(raw_json)
+{
+    struct Message
+    {
+        int id;
+        RawJson payload;
+    };
+    static const ReaderFields<Message> fields({ { "id", &Message::id }, { "payload", &Message::payload } }, true);
+    std::string payload = quotes("{ 'x' :5, 'str':'a}\\'b', 'words':[ 'c' ] }");
+    std::string json = quotes("{'payload':") + payload + quotes(" ,'id':3}");
+
+    // Captured as is from the input, across buffer refills, and parsed later
+    Message m = {};
+    read_json(json, make_json_fields_reader(&m, fields));
+    BOOST_CHECK_EQUAL(3, m.id);
+    BOOST_CHECK_EQUAL(payload, m.payload.json);
+    MyObject a;
+    read_json(m.payload.json, &a);
+    BOOST_CHECK_EQUAL(5, a.x);
+    BOOST_CHECK_EQUAL("a}\"b", a.str);
+    for (size_t buffer_size : { 1, 2, 7 })
+    {
+        Message n = {};
+        std::istringstream ss(json);
+        read_json(ss, make_json_fields_reader(&n, fields), buffer_size);
+        BOOST_CHECK_EQUAL(payload, n.payload.json);
+    }
+    for (const char *value : { "-1.5e3", "true", "null", "\"s\"", "[]" })
+    {
+        read_json(quotes("{'payload':") + value + "}", make_json_fields_reader(&m, fields));
+        BOOST_CHECK_EQUAL(value, m.payload.json);
+    }
+
+    // Rebuilt from the parse where it can not be captured
+    std::string compact = quotes("{'x':5,'str':'a}\\'b','words':['c']}");
+    std::string insitu = json;
+    read_json_insitu(insitu, make_json_fields_reader(&m, fields));
+    BOOST_CHECK_EQUAL(compact, m.payload.json);
+    RawJson root;
+    read_json(payload, &root);
+    BOOST_CHECK_EQUAL(compact, root.json);
+    std::vector<RawJson> elements;
+    read_json(quotes("[1, [2,{'a':[]}], 's']"), &elements);
+    BOOST_REQUIRE_EQUAL(3u, elements.size());
+    BOOST_CHECK_EQUAL("1", elements[0].json);
+    BOOST_CHECK_EQUAL(quotes("[2,{'a':[]}]"), elements[1].json);
+    BOOST_CHECK_EQUAL(quotes("'s'"), elements[2].json);
+
+    BOOST_CHECK_THROW(read_json(quotes("{'payload':[1}"), make_json_fields_reader(&m, fields)), std::runtime_error);
+    // Skipping alone would accept these
+    BOOST_CHECK_THROW(read_json(quotes("{'payload':[1},'id':3}"), make_json_fields_reader(&m, fields)), std::runtime_error);
+    BOOST_CHECK_THROW(read_json(quotes("{'payload':{'a':1]}"), make_json_fields_reader(&m, fields)), std::runtime_error);
+    BOOST_CHECK_THROW(read_json(quotes("{'payload':[1,,2]}"), make_json_fields_reader(&m, fields)), std::runtime_error);
+    BOOST_CHECK_THROW(read_json(quotes("{'payload':tru}"), make_json_fields_reader(&m, fields)), std::runtime_error);
+    std::istringstream ss(quotes("{'payload':[1, {'b':2]},'id':3}"));
+    BOOST_CHECK_THROW(read_json(ss, make_json_fields_reader(&m, fields), 3), std::runtime_error);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,9 +1,14 @@
 #include <boost/test/unit_test.hpp>
 #include "Writer.hpp"
+#include "WriterLines.hpp"
+#include "WriterCache.hpp"
+#include "JsonStats.hpp"
 #include <stdexcept>
 #include <algorithm>
 #include <vector>
 #include <list>
+#include <sstream>
+#include <limits>
 
 BOOST_AUTO_TEST_SUITE(TestWriter)
 
@@ -111,4 +116,532 @@ BOOST_AUTO_TEST_CASE(custom_type)
 
     BOOST_CHECK_EQUAL(quotes(expected), std::string(writer.data(), writer.size()));
 }
+BOOST_AUTO_TEST_CASE(sinks)
+{
+    MyObject a = { 55, "Hello World", { "Apple", "Orange"} };
+    std::string expected = quotes("{'x':55,'str':'Hello World','words':['Apple','Orange']}");
+
+    std::string out;
+    size_t writes = 0, max_write = 0;
+    JsonCallbackSink callback([&](const char *data, size_t len)
+    {
+        out.append(data, len);
+        ++writes;
+        max_write = std::max(max_write, len);
+    });
+    {
+        JsonWriter writer(callback, 8);
+        writer.value(a);
+        // Flushed once the top level value is complete
+        BOOST_CHECK_EQUAL(0, writer.size());
+    }
+    BOOST_CHECK_EQUAL(expected, out);
+    BOOST_CHECK(writes > 1);
+    // Only strings longer than the buffer bypass it
+    BOOST_CHECK(max_write <= a.str.size());
+
+    std::ostringstream ss;
+    JsonOStreamSink stream_sink(ss);
+    JsonWriter writer(stream_sink);
+    writer.start_array();
+    writer.value(a);
+    BOOST_CHECK_EQUAL("", ss.str());
+    writer.flush();
+    BOOST_CHECK_EQUAL("[" + expected, ss.str());
+    writer.end_array();
+    BOOST_CHECK_EQUAL("[" + expected + "]", ss.str());
+}
+BOOST_AUTO_TEST_CASE(reuse)
+{
+    MyObject a = { 55, "Hello World", { "Apple", "Orange"} };
+    std::string expected = quotes("{'x':55,'str':'Hello World','words':['Apple','Orange']}");
+
+    JsonWriter writer;
+    writer.reserve(4096);
+    BOOST_CHECK(writer.capacity() >= 4096);
+    for (int i = 0; i < 3; ++i)
+    {
+        writer.reset();
+        writer.value(a);
+        BOOST_CHECK_EQUAL(expected, std::string(writer.data(), writer.size()));
+    }
+    BOOST_CHECK(writer.capacity() >= 4096);
+
+    // Caller storage, used until it is outgrown
+    char storage[16];
+    JsonWriter small(storage, sizeof(storage));
+    small.value_string("Hello");
+    BOOST_CHECK_EQUAL((const void*)storage, (const void*)small.data());
+    small.reset();
+    small.value(a);
+    BOOST_CHECK_EQUAL(expected, std::string(small.data(), small.size()));
+
+    JsonWriterPool pool;
+    const JsonWriter *first;
+    {
+        auto pooled = pool.acquire();
+        first = &*pooled;
+        pooled->value(a);
+    }
+    {
+        auto pooled = pool.acquire();
+        BOOST_CHECK_EQUAL(first, &*pooled);
+        BOOST_CHECK_EQUAL(0, pooled->size());
+        pooled->value(a);
+        BOOST_CHECK_EQUAL(expected, std::string(pooled->data(), pooled->size()));
+    }
+}
+BOOST_AUTO_TEST_CASE(floats)
+{
+    JsonWriter writer;
+    writer.start_array();
+    writer.value(0.1f);
+    writer.value(1.0f);
+    writer.value(-2.5f);
+    writer.value(3.4028235e38f);
+    writer.value(1e-45f);
+    writer.value_float(3.14159f, 2);
+    writer.value_float(2.0f, 0);
+    writer.value_float(2.6f, 0);
+    writer.value_float(-1.5f, 3);
+    writer.end_array();
+    BOOST_CHECK_EQUAL("[0.1,1.0,-2.5,3.4028235e+38,1e-45,3.14,2,3,-1.500]",
+        std::string(writer.data(), writer.size()));
+
+    writer.reset();
+    BOOST_CHECK_THROW(writer.value_float(std::numeric_limits<float>::quiet_NaN()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(lines)
+{
+    std::vector<MyObject> objects;
+    std::string expected_lines, expected_array = "[";
+    for (int i = 0; i < 20000; ++i)
+    {
+        objects.push_back({ i, "Item " + std::to_string(i), { "a" } });
+        JsonWriter writer;
+        writer.value(objects.back());
+        std::string json(writer.data(), writer.size());
+        expected_lines += json + "\n";
+        expected_array += (i ? "," : "") + json;
+    }
+    expected_array += "]";
+
+    std::string out;
+    size_t flushes = 0;
+    class StringSink : public JsonSink
+    {
+    public:
+        StringSink(std::string &out, size_t &flushes) : out(out), flushes(flushes) {}
+        virtual void write(const char *data, size_t len)override { out.append(data, len); }
+        virtual void flush()override { ++flushes; }
+    private:
+        std::string &out;
+        size_t &flushes;
+    };
+    StringSink sink(out, flushes);
+
+    write_json_lines(objects, sink, JsonLinesFormat::lines, 4);
+    BOOST_CHECK(expected_lines == out);
+    BOOST_CHECK_EQUAL(1, flushes);
+
+    out.clear();
+    write_json_lines(objects, sink, JsonLinesFormat::array, 4);
+    BOOST_CHECK(expected_array == out);
+
+    out.clear();
+    std::vector<int> empty;
+    write_json_lines(empty, sink, JsonLinesFormat::array);
+    BOOST_CHECK_EQUAL("[]", out);
+
+    // next_document on a single writer
+    JsonWriter writer;
+    writer.value(1);
+    writer.next_document();
+    writer.value(2);
+    writer.next_document(',');
+    writer.value_string("x");
+    BOOST_CHECK_EQUAL("1\n2,\"x\"", std::string(writer.data(), writer.size()));
+
+    auto throwing = [](JsonWriter &writer, size_t i)
+    {
+        if (i == 5000) throw std::runtime_error("Failed");
+        writer.value_int((int)i);
+    };
+    BOOST_CHECK_THROW(write_json_lines(10000, throwing, sink, JsonLinesFormat::lines, 4), std::runtime_error);
+}
+
+// Written during static initialization, possibly before JsonEscape.cpp's own
+const std::string STATIC_ESCAPED = []()
+{
+    JsonWriter writer;
+    writer.value(std::string(40, '\n') + "\"");
+    return std::string(writer.data(), writer.size());
+}();
+BOOST_AUTO_TEST_CASE(escapes)
+{
+    std::string static_expected = "\"";
+    for (int i = 0; i < 40; ++i) static_expected += "\\n";
+    static_expected += "\\\"\"";
+    BOOST_CHECK_EQUAL(static_expected, STATIC_ESCAPED);
+
+    JsonWriter writer;
+    writer.start_object();
+    writer.key("k\"\\");
+    writer.value_string(std::string("a\"b\\c/\b\f\n\r\t\x01\x1F\x7F\xC3\xA9\0z", 18));
+    writer.end_object();
+    BOOST_CHECK_EQUAL(
+        "{\"k\\\"\\\\\":\"a\\\"b\\\\c/\\b\\f\\n\\r\\t\\u0001\\u001F\x7F\xC3\xA9\\u0000z\"}",
+        std::string(writer.data(), writer.size()));
+
+    // Escapes at every offset of long strings, to cover the vector loops and their tails
+    for (size_t len = 1; len < 80; ++len)
+    {
+        for (size_t i = 0; i < len; ++i)
+        {
+            std::string str(len, '\xE0');
+            str[i] = '\n';
+            std::string expected = "\"" + str.substr(0, i) + "\\n" + str.substr(i + 1) + "\"";
+            writer.reset();
+            writer.value_string(str);
+            BOOST_CHECK_EQUAL(expected, std::string(writer.data(), writer.size()));
+        }
+    }
+
+    // Long unescaped runs pass straight through to a sink
+    std::string long_str(100000, 'x');
+    long_str[50000] = '"';
+    std::string out;
+    JsonCallbackSink sink([&](const char *data, size_t len) { out.append(data, len); });
+    JsonWriter sink_writer(sink, 1024);
+    sink_writer.start_array();
+    sink_writer.value_string(long_str);
+    sink_writer.value_string(long_str);
+    sink_writer.end_array();
+    std::string expected_str = "\"" + long_str.substr(0, 50000) + "\\\"" + long_str.substr(50001) + "\"";
+    BOOST_CHECK(out == "[" + expected_str + "," + expected_str + "]");
+}
+BOOST_AUTO_TEST_CASE(stats)
+{
+    JsonStats stats;
+    JsonStatsScope scope(stats);
+    JsonWriter writer;
+    writer.value(std::vector<int>{ 1, 2, 3 });
+    size_t first = writer.size();
+    writer.reset();
+    writer.value(std::string(1000, 'x'));
+    size_t second = writer.size();
+
+    std::string out;
+    JsonCallbackSink sink([&](const char *data, size_t len) { out.append(data, len); });
+    JsonWriter sink_writer(sink, 64);
+    sink_writer.value(std::vector<std::string>(10, std::string(100, 'y')));
+    sink_writer.flush();
+
+#ifdef RAPIDJSON_EXT_STATS
+    // The stats build, see tests/Makefile, must reach the checks below
+    BOOST_REQUIRE(json_stats_enabled());
+#endif
+    if (!json_stats_enabled())
+    {
+        BOOST_CHECK_EQUAL(0, stats.documents_written);
+        return;
+    }
+    BOOST_CHECK_EQUAL(3, stats.documents_written);
+    BOOST_CHECK_EQUAL(first + second + out.size(), stats.bytes_written);
+    BOOST_CHECK(stats.buffer_grows > 0);
+}
+BOOST_AUTO_TEST_CASE(compile_time_keys)
+{
+    static constexpr JsonKey KEY_A("a");
+    static constexpr JsonKey KEY_ESCAPED("k\"\\\n\x01");
+    static_assert(KEY_A.size() == 3, "JsonKey is quoted");
+
+    JsonWriter writer, expected;
+    for (auto w : { &writer, &expected })
+    {
+        w->start_object();
+        if (w == &writer)
+        {
+            writer.prop(KEY_A, 5);
+            writer.key(KEY_ESCAPED);
+        }
+        else
+        {
+            expected.prop("a", 5);
+            expected.key("k\"\\\n\x01");
+        }
+        w->start_array();
+        w->start_object();
+        if (w == &writer) writer.prop(KEY_A, true);
+        else expected.prop("a", true);
+        w->end_object();
+        w->end_array();
+        w->end_object();
+    }
+    BOOST_CHECK_EQUAL(std::string(expected.data(), expected.size()), std::string(writer.data(), writer.size()));
+    BOOST_CHECK_EQUAL("{\"a\":5,\"k\\\"\\\\\\n\\u0001\":[{\"a\":true}]}", std::string(writer.data(), writer.size()));
+}
+BOOST_AUTO_TEST_CASE(number_arrays)
+{
+    // Bulk output matches writing each element
+    auto check_array = [](const auto &arr)
+    {
+        JsonWriter bulk, each;
+        bulk.value(arr);
+        each.start_array();
+        for (auto x : arr) each.value(x);
+        each.end_array();
+        BOOST_CHECK_EQUAL(std::string(each.data(), each.size()), std::string(bulk.data(), bulk.size()));
+
+        // Through a sink whose buffer holds only a few elements
+        std::string out;
+        JsonCallbackSink sink([&](const char *data, size_t len) { out.append(data, len); });
+        JsonWriter small(sink, 40);
+        small.value(arr);
+        BOOST_CHECK_EQUAL(std::string(each.data(), each.size()), out);
+        BOOST_CHECK_EQUAL(40, small.capacity());
+    };
+    std::vector<int> ints = { 0, 1, -1, 9, 10, 99, 100, -100, 12345, 2147483647, -2147483647 - 1 };
+    for (int i = 1; i < 1000000000; i *= 10) ints.insert(ints.end(), { i - 1, i, -i, 1 - i });
+    check_array(ints);
+    std::vector<long long> int64s = { 0, -1, 9223372036854775807ll, -9223372036854775807ll - 1 };
+    for (long long i = 1; i < 1000000000000000000ll; i *= 10) int64s.insert(int64s.end(), { i - 1, i, -i });
+    check_array(int64s);
+    std::vector<unsigned long long> uint64s = { 0, 18446744073709551615ull, 10000000000000000000ull, 9999999999999999999ull };
+    check_array(uint64s);
+    unsigned uints[] = { 0, 4294967295u, 1000000000u };
+    check_array(uints);
+    std::vector<double> doubles = { 0, -0.0, 1, 0.1, -2.5, 1e300, 1e-300, 123456789012345678.0, 3.14159 };
+    check_array(doubles);
+    std::vector<float> floats = { 0, 1, 0.1f, -2.5f, 3e38f, 1e-45f, 16777216.0f };
+    check_array(floats);
+    check_array(std::vector<int>());
+
+    // In other values, with commas and keys around them
+    JsonWriter writer;
+    writer.start_object();
+    writer.prop("a", std::vector<int>({ 1, -2 }));
+    writer.prop("b", std::vector<std::vector<double>>({ { 1.5 }, {}, { 2, 3 } }));
+    writer.end_object();
+    BOOST_CHECK_EQUAL("{\"a\":[1,-2],\"b\":[[1.5],[],[2.0,3.0]]}", std::string(writer.data(), writer.size()));
+
+    // Caller storage is kept while the output fits, even without room for the longest elements
+    char storage[64];
+    JsonWriter fixed(storage, sizeof(storage));
+    fixed.start_array();
+    fixed.value_string(std::string(30, 'x'));
+    fixed.value(std::vector<int>({ 1, 2, 3 }));
+    fixed.value(std::vector<double>({ 1.5 }));
+    fixed.end_array();
+    BOOST_CHECK_EQUAL("[\"" + std::string(30, 'x') + "\",[1,2,3],[1.5]]", std::string(fixed.data(), fixed.size()));
+    BOOST_CHECK_EQUAL((const void*)storage, (const void*)fixed.data());
+
+    // Non-finite values fail without writing anything
+    writer.reset();
+    writer.start_array();
+    std::vector<double> bad = { 1, std::numeric_limits<double>::infinity() };
+    BOOST_CHECK_THROW(writer.value(bad), std::runtime_error);
+    BOOST_CHECK_EQUAL("[", std::string(writer.data(), writer.size()));
+    std::vector<float> bad_floats = { std::numeric_limits<float>::quiet_NaN() };
+    BOOST_CHECK_THROW(writer.value(bad_floats), std::runtime_error);
+}
+BOOST_AUTO_TEST_CASE(cbor)
+{
+    auto hex = [](const JsonWriter &writer)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        for (size_t i = 0; i < writer.size(); ++i)
+        {
+            unsigned char c = (unsigned char)writer.data()[i];
+            out += digits[c >> 4];
+            out += digits[c & 15];
+        }
+        return out;
+    };
+    JsonWriter writer;
+    writer.set_encoding(JsonEncoding::cbor);
+    writer.start_array();
+    for (long long x : { 0ll, 23ll, 24ll, 100ll, 1000ll, 1000000ll, 1000000000000ll, -1ll, -100ll, -1000ll })
+    {
+        writer.value(x);
+    }
+    writer.value(18446744073709551615ull);
+    writer.value(1.5);
+    writer.value(1.1);
+    writer.value(0.25f);
+    writer.value(true);
+    writer.value(false);
+    writer.value_null();
+    writer.value(std::string());
+    writer.value(std::string("a"));
+    writer.end_array();
+    BOOST_CHECK_EQUAL(
+        "9f"
+        "00" "17" "1818" "1864" "1903e8" "1a000f4240" "1b000000e8d4a51000" "20" "3863" "3903e7"
+        "1bffffffffffffffff"
+        "fa3fc00000" "fb3ff199999999999a" "fa3e800000"
+        "f5" "f4" "f6" "60" "6161"
+        "ff",
+        hex(writer));
+
+    // Objects, keys and bulk arrays
+    static constexpr JsonKey KEY_B("b");
+    writer.reset();
+    writer.start_object();
+    writer.prop("a", std::vector<int>({ 1, 2, 3 }));
+    writer.prop(KEY_B, std::vector<double>());
+    writer.end_object();
+    BOOST_CHECK_EQUAL("bf" "6161" "83010203" "6162" "80" "ff", hex(writer));
+
+    // The same write_json overloads give smaller output
+    MyObject a = { 55, "Hello World", { "Apple", "Orange"} };
+    writer.reset();
+    writer.value(a);
+    size_t cbor_size = writer.size();
+    JsonWriter json;
+    json.value(a);
+    BOOST_CHECK_LT(cbor_size, json.size());
+
+    // A sequence of documents has no separators, and each is flushed to a sink when complete
+    std::string out;
+    JsonCallbackSink sink([&](const char *data, size_t len) { out.append(data, len); });
+    JsonWriter sink_writer(sink);
+    sink_writer.set_encoding(JsonEncoding::cbor);
+    sink_writer.value(1);
+    BOOST_CHECK_EQUAL(1, out.size());
+    sink_writer.next_document();
+    sink_writer.value(2);
+    BOOST_CHECK_EQUAL("\x01\x02", out);
+
+    // The same errors as for JSON
+    writer.reset();
+    BOOST_CHECK_THROW(writer.value(std::numeric_limits<double>::infinity()), std::runtime_error);
+    BOOST_CHECK_THROW(writer.end_array(), std::runtime_error);
+
+    // A pooled writer is JSON again for the next borrower
+    JsonWriterPool pool;
+    {
+        auto pooled = pool.acquire();
+        pooled->set_encoding(JsonEncoding::cbor);
+        pooled->value(a);
+    }
+    {
+        auto pooled = pool.acquire();
+        BOOST_CHECK(pooled->encoding() == JsonEncoding::json);
+        pooled->value(a);
+        BOOST_CHECK_EQUAL(std::string(json.data(), json.size()), std::string(pooled->data(), pooled->size()));
+    }
+}
+// Counts its serializations, for the fragment cache
+struct CountedObject
+{
+    int x;
+    mutable int writes;
+};
+void write_json(JsonWriter &writer, const CountedObject &obj)
+{
+    ++obj.writes;
+    writer.start_object();
+    writer.prop("x", obj.x);
+    writer.end_object();
+}
+// Shares its address with inner
+struct CountedOuter
+{
+    CountedObject inner;
+};
+void write_json(JsonWriter &writer, const CountedOuter &obj)
+{
+    writer.start_array();
+    write_json(writer, obj.inner);
+    writer.end_array();
+}
+BOOST_AUTO_TEST_CASE(raw_values)
+{
+    // Separators and nesting are kept around the spliced text
+    RawJson raw = { quotes("{ 'a' : [1, 2] }") };
+    JsonWriter writer;
+    writer.start_array();
+    writer.value_raw("1", 1);
+    writer.value(raw);
+    writer.start_object();
+    writer.key("b");
+    writer.value_raw(std::string("null"));
+    writer.prop("c", 2);
+    writer.end_object();
+    writer.end_array();
+    BOOST_CHECK_EQUAL(quotes("[1,{ 'a' : [1, 2] },{'b':null,'c':2}]"), std::string(writer.data(), writer.size()));
+
+    // Empty text is not a value
+    writer.reset();
+    writer.start_array();
+    BOOST_CHECK_THROW(writer.value_raw("", 0), std::runtime_error);
+    BOOST_CHECK_THROW(writer.value_raw(" \n", 2), std::runtime_error);
+    writer.value(RawJson());
+    writer.value(1);
+    writer.end_array();
+    BOOST_CHECK_EQUAL("[null,1]", std::string(writer.data(), writer.size()));
+
+    // A top level raw value completes the document
+    std::string out;
+    JsonCallbackSink sink([&](const char *data, size_t len) { out.append(data, len); });
+    JsonWriter sink_writer(sink);
+    sink_writer.value(raw);
+    BOOST_CHECK_EQUAL(raw.json, out);
+
+    // CBOR output encodes the parsed text
+    JsonWriter cbor;
+    cbor.set_encoding(JsonEncoding::cbor);
+    cbor.value(raw);
+    BOOST_CHECK_EQUAL(std::string("\xBF\x61" "a" "\x9F\x01\x02\xFF\xFF", 8), std::string(cbor.data(), cbor.size()));
+    cbor.reset();
+    cbor.start_array();
+    BOOST_CHECK_THROW(cbor.value_raw("[1,", 3), std::runtime_error);
+    BOOST_CHECK_EQUAL(std::string("\x9F", 1), std::string(cbor.data(), cbor.size()));
+    cbor.value(1);
+    cbor.end_array();
+    BOOST_CHECK_EQUAL(std::string("\x9F\x01\xFF", 3), std::string(cbor.data(), cbor.size()));
+    BOOST_CHECK_THROW(cbor.end_array(), std::runtime_error);
+
+    // Cached fragments are only serialized again for a new version
+    JsonFragmentCache cache;
+    CountedObject obj = { 5, 0 };
+    for (uint64_t version : { 1, 1, 2, 2 })
+    {
+        writer.reset();
+        writer.start_array();
+        cache.write(writer, obj, version);
+        cache.write(writer, obj, version);
+        writer.end_array();
+        BOOST_CHECK_EQUAL(quotes("[{'x':5},{'x':5}]"), std::string(writer.data(), writer.size()));
+    }
+    BOOST_CHECK_EQUAL(2, obj.writes);
+    BOOST_CHECK_EQUAL(1u, cache.size());
+    cbor.reset();
+    cache.write(cbor, obj, 2);
+    BOOST_CHECK_EQUAL(3, obj.writes);
+    cache.erase(obj);
+    BOOST_CHECK_EQUAL(0u, cache.size());
+
+    // An object and its first member share an address
+    CountedOuter outer = { { 7, 0 } };
+    writer.reset();
+    writer.start_array();
+    cache.write(writer, outer, 1);
+    cache.write(writer, outer.inner, 1);
+    writer.end_array();
+    BOOST_CHECK_EQUAL(quotes("[[{'x':7}],{'x':7}]"), std::string(writer.data(), writer.size()));
+    BOOST_CHECK_EQUAL(2u, cache.size());
+
+    // Full caches start over
+    JsonFragmentCache small(2);
+    CountedObject objs[3] = { { 1, 0 }, { 2, 0 }, { 3, 0 } };
+    writer.reset();
+    writer.start_array();
+    for (auto &o : objs) small.write(writer, o, 1);
+    writer.end_array();
+    BOOST_CHECK_EQUAL(1u, small.size());
+}
 BOOST_AUTO_TEST_SUITE_END()